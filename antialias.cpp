@@ -0,0 +1,185 @@
+#include "antialias.h"
+#include "render.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A pixel is supersampled if a neighbour's colour differs from its own by
+// more than this in any channel.
+constexpr int edge_contrast = 24;
+
+int contrast(uint32_t a, uint32_t b) {
+   int most = 0;
+   for (int shift = 8; shift < 32; shift += 8)
+      most = std::max(most, std::abs(static_cast<int>((a >> shift) & 0xff) -
+                                     static_cast<int>((b >> shift) & 0xff)));
+   return most;
+}
+
+// A pseudo-random number in [0, 1) fixed by its arguments, so that renders
+// are repeatable.
+double jitter(size_t x, size_t y, size_t index) {
+   uint64_t h = (x * 0x9e3779b97f4a7c15ull) ^ (y * 0xbf58476d1ce4e5b9ull) ^
+                (index * 0x94d049bb133111ebull);
+   h ^= h >> 31;
+   h *= 0xbf58476d1ce4e5b9ull;
+   h ^= h >> 27;
+   h *= 0x94d049bb133111ebull;
+   h ^= h >> 31;
+   return std::ldexp(static_cast<double>(h >> 11), -53);
+}
+
+uint32_t average(const std::vector<uint32_t> &colours) {
+   size_t count = colours.size();
+   uint32_t result = 0;
+   for (int shift = 0; shift < 32; shift += 8) {
+      size_t sum = 0;
+      for (uint32_t colour : colours)
+         sum += (colour >> shift) & 0xff;
+      result |= static_cast<uint32_t>((sum + count / 2) / count) << shift;
+   }
+   return result;
+}
+
+template <typename Float_type>
+void escape_points(const Fractal &fractal, const Viewport &viewport,
+                   const std::vector<double> &xs,
+                   const std::vector<double> &ys, int *iterations,
+                   double *norms) {
+   std::vector<Float_type> re(xs.size());
+   std::vector<Float_type> im(ys.size());
+   for (size_t k = 0; k < xs.size(); ++k) {
+      re[k] = plane_coordinate<Float_type>(viewport.centre_re,
+                                           offset_re(viewport, xs[k]));
+      im[k] = plane_coordinate<Float_type>(viewport.centre_im,
+                                           offset_im(viewport, ys[k]));
+   }
+   escape_time(fractal, re.data(), im.data(), re.size(), iterations, norms);
+}
+
+// Iterates the points at normalised image coordinates (xs[k], ys[k]).
+void escape_points(const Fractal &fractal, const Render_settings &settings,
+                   const std::vector<double> &xs,
+                   const std::vector<double> &ys, int *iterations,
+                   double *norms) {
+   switch (settings.precision) {
+   case Precision::float32:
+      escape_points<float>(fractal, settings.viewport, xs, ys, iterations,
+                           norms);
+      break;
+   case Precision::automatic:
+   case Precision::float64:
+      escape_points<double>(fractal, settings.viewport, xs, ys, iterations,
+                            norms);
+      break;
+   case Precision::double_double:
+      escape_points<Double_double>(fractal, settings.viewport, xs, ys,
+                                   iterations, norms);
+      break;
+   }
+}
+
+} // namespace
+
+std::future<void> submit_antialiasing(Thread_pool &pool,
+                                      const Fractal &fractal,
+                                      const Render_settings &settings,
+                                      const Escape_buffer &escape,
+                                      size_t samples, uint8_t *pixels,
+                                      size_t pitch) {
+   auto grid = static_cast<size_t>(
+       std::lround(std::sqrt(static_cast<double>(samples))));
+   if (grid == 0 || grid * grid != samples)
+      throw std::runtime_error("Antialiasing samples must be a square: " +
+                               std::to_string(samples));
+   const Escape_buffer *source = &escape;
+   auto table = std::make_shared<std::vector<uint32_t>>(
+       settings.palette.unroll(escape.max_iter, 0));
+   return submit_tiles(
+       pool, pixels, escape.width, escape.height, pitch,
+       [fractal, settings, source, table, grid](const Tile &tile,
+                                                const double *,
+                                                const double *, uint32_t *out,
+                                                size_t stride) {
+          size_t width = source->width;
+          size_t height = source->height;
+          const Palette &palette = settings.palette;
+          auto colour = [&](size_t x, size_t y) {
+             size_t k = y * width + x;
+             if (palette.smooth)
+                return palette.colour(source->iterations[k],
+                                      source->norms[k]);
+             return source->norms[k] > 4.0f
+                        ? (*table)[std::min(source->iterations[k],
+                                            source->max_iter)]
+                        : palette.inside;
+          };
+
+          // Colour every pixel from its one sample, noting the edges.
+          std::vector<size_t> edges;
+          for (size_t i = 0; i < tile.height; ++i) {
+             size_t y = tile.y + i;
+             for (size_t j = 0; j < tile.width; ++j) {
+                size_t x = tile.x + j;
+                uint32_t c = colour(x, y);
+                out[i * stride + j] = c;
+                if ((x > 0 && contrast(c, colour(x - 1, y)) > edge_contrast) ||
+                    (x + 1 < width &&
+                     contrast(c, colour(x + 1, y)) > edge_contrast) ||
+                    (y > 0 && contrast(c, colour(x, y - 1)) > edge_contrast) ||
+                    (y + 1 < height &&
+                     contrast(c, colour(x, y + 1)) > edge_contrast))
+                   edges.push_back(i * tile.width + j);
+             }
+          }
+          if (edges.empty())
+             return;
+
+          // One sample jittered within each cell of a grid x grid division
+          // of every edge pixel, all iterated in one batch.
+          size_t samples = grid * grid;
+          std::vector<double> xs, ys;
+          xs.reserve(edges.size() * samples);
+          ys.reserve(edges.size() * samples);
+          auto position = [grid](size_t pixel, size_t cell, double offset,
+                                 size_t size) {
+             return (static_cast<double>(pixel) +
+                     (static_cast<double>(cell) + offset) /
+                         static_cast<double>(grid)) /
+                    static_cast<double>(size);
+          };
+          for (size_t edge : edges) {
+             size_t x = tile.x + edge % tile.width;
+             size_t y = tile.y + edge / tile.width;
+             for (size_t a = 0; a < grid; ++a)
+                for (size_t b = 0; b < grid; ++b) {
+                   size_t s = a * grid + b;
+                   xs.push_back(position(x, b, jitter(x, y, 2 * s), width));
+                   ys.push_back(
+                       position(y, a, jitter(x, y, 2 * s + 1), height));
+                }
+          }
+          std::vector<int> iterations(xs.size());
+          std::vector<double> norms(xs.size());
+          escape_points(fractal, settings, xs, ys, iterations.data(),
+                        norms.data());
+
+          std::vector<uint32_t> colours(samples);
+          for (size_t n = 0; n < edges.size(); ++n) {
+             for (size_t s = 0; s < samples; ++s)
+                colours[s] = settings.palette.colour(
+                    static_cast<uint32_t>(iterations[n * samples + s]),
+                    compact_norm(norms[n * samples + s]));
+             size_t edge = edges[n];
+             out[edge / tile.width * stride + edge % tile.width] =
+                 average(colours);
+          }
+       });
+}
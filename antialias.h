@@ -0,0 +1,24 @@
+#pragma once
+
+#include "escape_buffer.h"
+#include "escape_time.h"
+#include "frame.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+
+// Starts colouring escape, rendered from fractal with settings, into an
+// RGBA8888 image as submit_colouring() does, then replaces each pixel that
+// contrasts sharply with a neighbour by the average of samples jittered
+// samples over its area. samples must be a square, such as 4 or 16. Smooth
+// regions keep their single sample, so this costs a fraction of uniform
+// supersampling. escape and pixels must stay valid until the future is
+// ready.
+std::future<void> submit_antialiasing(Thread_pool &pool,
+                                      const Fractal &fractal,
+                                      const Render_settings &settings,
+                                      const Escape_buffer &escape,
+                                      size_t samples, uint8_t *pixels,
+                                      size_t pitch);
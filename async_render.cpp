@@ -0,0 +1,126 @@
+#include "async_render.h"
+
+#include "trace.h"
+#include "viewport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+struct Render_job::State {
+   Fractal fractal;
+   Render_settings settings;
+   Tile_callback on_tile;
+   uint32_t *pixels;
+   size_t stride;
+   std::vector<double> xs;
+   std::vector<double> ys;
+   // Nearest the centre first. Each task renders the next tile not yet
+   // taken rather than the one at its own index, since the pool hands out
+   // indices a range per worker rather than in order.
+   std::vector<Tile> tiles;
+   std::atomic<size_t> next{0};
+   std::atomic<size_t> done{0};
+   std::atomic<bool> cancelled{false};
+   std::shared_future<void> finished;
+};
+
+const std::shared_future<void> &Render_job::finished() const {
+   return state_->finished;
+}
+
+bool Render_job::done() const {
+   return state_ != nullptr &&
+          state_->finished.wait_for(std::chrono::seconds(0)) ==
+              std::future_status::ready;
+}
+
+void Render_job::cancel() {
+   if (state_ != nullptr)
+      state_->cancelled.store(true, std::memory_order_relaxed);
+}
+
+bool Render_job::cancelled() const {
+   return state_ != nullptr &&
+          state_->cancelled.load(std::memory_order_relaxed);
+}
+
+size_t Render_job::tiles_done() const {
+   return state_->done.load(std::memory_order_relaxed);
+}
+
+size_t Render_job::tile_count() const { return state_->tiles.size(); }
+
+Render_job submit_render(Thread_pool &pool, const Fractal &fractal,
+                         const Render_settings &settings, uint8_t *pixels,
+                         size_t width, size_t height, size_t pitch,
+                         Tile_callback on_tile, size_t tile_size) {
+   auto state = std::make_shared<Render_job::State>();
+   state->fractal = fractal;
+   state->settings = settings;
+   state->settings.precision = resolve_precision(
+       settings.precision, settings.viewport, width, height);
+   state->settings.pixel_size =
+       2 * settings.viewport.half_width / static_cast<double>(width);
+   state->on_tile = std::move(on_tile);
+   state->pixels = reinterpret_cast<uint32_t *>(pixels);
+   state->stride = pitch / sizeof(uint32_t);
+   for (size_t j = 0; j < width; ++j)
+      state->xs.push_back(static_cast<double>(j) /
+                          static_cast<double>(width));
+   for (size_t i = 0; i < height; ++i)
+      state->ys.push_back(static_cast<double>(i) /
+                          static_cast<double>(height));
+
+   state->tiles = make_tiles(width, height, tile_size);
+   // The squared distance from the image's centre to the tile's, doubled.
+   auto distance = [width, height](const Tile &tile) {
+      auto dx = static_cast<double>(2 * tile.x + tile.width) -
+                static_cast<double>(width);
+      auto dy = static_cast<double>(2 * tile.y + tile.height) -
+                static_cast<double>(height);
+      return dx * dx + dy * dy;
+   };
+   std::stable_sort(state->tiles.begin(), state->tiles.end(),
+                    [&distance](const Tile &a, const Tile &b) {
+                       return distance(a) < distance(b);
+                    });
+
+   std::future<void> finished =
+       pool.submit(state->tiles.size(), [state](size_t, size_t) {
+          if (state->cancelled.load(std::memory_order_relaxed))
+             return;
+          const Tile &tile = state->tiles[state->next.fetch_add(1)];
+          Trace_scope scope("tile", tile.x, tile.y);
+          fractal_tile(state->fractal, state->settings, tile,
+                       state->xs.data() + tile.x, state->ys.data() + tile.y,
+                       state->pixels + tile.y * state->stride + tile.x,
+                       state->stride);
+          state->done.fetch_add(1, std::memory_order_relaxed);
+          if (state->on_tile)
+             state->on_tile(tile);
+       });
+   state->finished = finished.share();
+
+   Render_job result;
+   result.state_ = std::move(state);
+   return result;
+}
+
+View_renderer::~View_renderer() {
+   current_.cancel();
+   if (current_.started())
+      current_.finished().wait();
+}
+
+Render_job View_renderer::render(const Fractal &fractal,
+                                 const Render_settings &settings,
+                                 uint8_t *pixels, size_t width, size_t height,
+                                 size_t pitch, Tile_callback on_tile) {
+   current_.cancel();
+   current_ = submit_render(pool_, fractal, settings, pixels, width, height,
+                            pitch, std::move(on_tile));
+   return current_;
+}
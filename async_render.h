@@ -0,0 +1,96 @@
+#pragma once
+
+#include "escape_time.h"
+#include "frame.h"
+#include "render.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+
+// Rendering for callers that run an event loop of their own and cannot
+// block on a frame: a render is started, polled or waited on through its
+// future, watched tile by tile through a callback, and cancelled once its
+// view is stale.
+
+// Called on a worker thread as each tile of a render finishes; the tile's
+// pixels are final from then on. It must be quick and must not wait on the
+// pool; it is meant for posting the tile to the caller's own loop.
+using Tile_callback = std::function<void(const Tile &tile)>;
+
+// A render running on a pool. Copies share the one render.
+class Render_job {
+ public:
+   // No render: started(), done() and cancelled() are false, cancel() does
+   // nothing, and nothing else may be called.
+   Render_job() = default;
+
+   bool started() const { return state_ != nullptr; }
+
+   // Ready once every tile has been rendered or, after cancel(), skipped.
+   // Rethrows the first exception thrown by any tile.
+   const std::shared_future<void> &finished() const;
+
+   // Whether finished() is ready, without waiting.
+   bool done() const;
+
+   // Skips every tile not yet started. Tiles already rendering still
+   // finish, so the render stops within the time of one tile, with the
+   // image left incomplete.
+   void cancel();
+   bool cancelled() const;
+
+   size_t tiles_done() const;
+   size_t tile_count() const;
+
+ private:
+   struct State;
+
+   friend Render_job submit_render(Thread_pool &pool, const Fractal &fractal,
+                                   const Render_settings &settings,
+                                   uint8_t *pixels, size_t width,
+                                   size_t height, size_t pitch,
+                                   Tile_callback on_tile, size_t tile_size);
+
+   std::shared_ptr<State> state_;
+};
+
+// Starts rendering fractal over settings.viewport into the width x height
+// RGBA8888 image at pixels, as fractal_tile() colours it, and returns at
+// once. An automatic precision is resolved for the image size. Tiles are
+// started nearest the centre of the image first, which is where a viewer
+// looks, so that a render cancelled early has at least filled the middle.
+// pixels must stay valid until finished() is ready.
+Render_job submit_render(Thread_pool &pool, const Fractal &fractal,
+                         const Render_settings &settings, uint8_t *pixels,
+                         size_t width, size_t height, size_t pitch,
+                         Tile_callback on_tile = nullptr,
+                         size_t tile_size = default_tile_size);
+
+// Keeps one render going for a view that keeps changing: each render()
+// cancels the one before it, so no time goes on frames nobody will see.
+class View_renderer {
+ public:
+   explicit View_renderer(Thread_pool &pool) : pool_(pool) {}
+   // Cancels the current render and waits for its tiles in flight.
+   ~View_renderer();
+
+   View_renderer(const View_renderer &) = delete;
+   View_renderer &operator=(const View_renderer &) = delete;
+
+   // As submit_render(). The previous render's tiles in flight may still
+   // be writing its pixels for the time of one tile; wait on its
+   // finished() before reusing them.
+   Render_job render(const Fractal &fractal, const Render_settings &settings,
+                     uint8_t *pixels, size_t width, size_t height,
+                     size_t pitch, Tile_callback on_tile = nullptr);
+
+   const Render_job &current() const { return current_; }
+
+ private:
+   Thread_pool &pool_;
+   Render_job current_;
+};
@@ -0,0 +1,333 @@
+#include "escape_time.h"
+#include "frame.h"
+#include "render.h"
+#include "thread_pool.h"
+#include "viewport.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <complex>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Renders fixed views through the same tile functions as the viewer and
+// reports throughput and scaling across thread counts as CSV or JSON, so
+// that builds can be compared.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Kind { mandelbrot, julia, animate_julia };
+
+struct Bench_case {
+   std::string name;
+   Kind kind;
+   Viewport viewport;
+   size_t width;
+   size_t height;
+   int max_iter;
+   // The Julia constant for julia, ignored otherwise.
+   std::complex<double> c;
+   // Animation times for animate_julia; other kinds render one frame.
+   std::vector<double> times;
+};
+
+std::vector<Bench_case> bench_cases() {
+   std::vector<double> times;
+   for (int k = 0; k < 8; ++k)
+      times.push_back(0.25 * k);
+   Viewport seahorse{-0.745, 0.11, 0.01, 0.01};
+   return {
+       {"mandelbrot", Kind::mandelbrot, default_viewport(), 1024, 1024, 1000,
+        0.0, {0.0}},
+       {"mandelbrot_seahorse", Kind::mandelbrot, seahorse, 1024, 1024, 5000,
+        0.0, {0.0}},
+       {"julia", Kind::julia, default_viewport(), 1024, 1024, 1000,
+        {-0.8, 0.156}, {0.0}},
+       {"animate_julia", Kind::animate_julia, default_viewport(), 1024, 1024,
+        1000, 0.0, times},
+   };
+}
+
+// Like generate_tiles(), but f(tile, index, x, y, out, stride, worker) is
+// also told the tile's index and which worker runs it.
+template <typename Func>
+void bench_tiles(Thread_pool &pool, uint32_t *pixels, size_t width,
+                 size_t height, Func f) {
+   std::vector<double> xs(width);
+   std::vector<double> ys(height);
+   for (size_t j = 0; j < width; ++j)
+      xs[j] = static_cast<double>(j) / static_cast<double>(width);
+   for (size_t i = 0; i < height; ++i)
+      ys[i] = static_cast<double>(i) / static_cast<double>(height);
+   std::vector<Tile> tiles = make_tiles(width, height, default_tile_size);
+   pool.run(tiles.size(), [&](size_t index, size_t worker) {
+      const Tile &tile = tiles[index];
+      f(tile, index, xs.data() + tile.x, ys.data() + tile.y,
+        pixels + tile.y * width + tile.x, width, worker);
+   });
+}
+
+Fractal frame_fractal(const Bench_case &bench, double t) {
+   switch (bench.kind) {
+   case Kind::mandelbrot:
+      return {Fractal_type::mandelbrot, 0.0, bench.max_iter};
+   case Kind::julia:
+      return {Fractal_type::julia, bench.c, bench.max_iter};
+   case Kind::animate_julia:
+      break;
+   }
+   return {Fractal_type::julia, julia_constant(t), bench.max_iter};
+}
+
+// The escape counts summed over every frame of a case: the work a loop with
+// no early-outs would do.
+double total_iterations(Thread_pool &pool, const Bench_case &bench,
+                        const Render_settings &settings) {
+   size_t num_tiles =
+       make_tiles(bench.width, bench.height, default_tile_size).size();
+   double total = 0;
+   for (double t : bench.times) {
+      Fractal fractal = frame_fractal(bench, t);
+      std::vector<double> sums(num_tiles);
+      bench_tiles(pool, nullptr, bench.width, bench.height,
+                  [&](const Tile &tile, size_t index, const double *x,
+                      const double *y, uint32_t *, size_t, size_t) {
+                     std::vector<int> iterations(tile.width * tile.height);
+                     std::vector<double> norms(tile.width * tile.height);
+                     fractal_escape_tile(fractal, settings, tile, x, y,
+                                         iterations.data(), norms.data());
+                     sums[index] = std::accumulate(iterations.begin(),
+                                                   iterations.end(), 0.0);
+                  });
+      total = std::accumulate(sums.begin(), sums.end(), total);
+   }
+   return total;
+}
+
+struct Measurement {
+   double seconds;
+   // Time each worker spent inside tile functions.
+   std::vector<double> busy;
+};
+
+Measurement measure(Thread_pool &pool, const Bench_case &bench,
+                    const Render_settings &settings) {
+   // Left for first_touch() to place, rather than zeroed by this thread.
+   std::unique_ptr<uint32_t[]> pixels(
+       new uint32_t[bench.width * bench.height]);
+   first_touch(pool, reinterpret_cast<uint8_t *>(pixels.get()), bench.width,
+               bench.height, bench.width * sizeof(uint32_t));
+   Measurement result{0, std::vector<double>(pool.size())};
+   auto start = Clock::now();
+   for (double t : bench.times) {
+      bench_tiles(pool, pixels.get(), bench.width, bench.height,
+                  [&](const Tile &tile, size_t, const double *x,
+                      const double *y, uint32_t *out, size_t stride,
+                      size_t worker) {
+                     auto tile_start = Clock::now();
+                     switch (bench.kind) {
+                     case Kind::mandelbrot:
+                        mandelbrot(settings, tile, x, y, out, stride);
+                        break;
+                     case Kind::julia:
+                        julia(settings, bench.c, tile, x, y, out, stride);
+                        break;
+                     case Kind::animate_julia:
+                        animate_julia(settings, t, tile, x, y, out, stride);
+                        break;
+                     }
+                     // Each worker only ever touches its own entry.
+                     result.busy[worker] += std::chrono::duration<double>(
+                                                Clock::now() - tile_start)
+                                                .count();
+                  });
+   }
+   result.seconds =
+       std::chrono::duration<double>(Clock::now() - start).count();
+   return result;
+}
+
+struct Result {
+   const Bench_case *bench;
+   const char *precision;
+   size_t threads;
+   double seconds;
+   double megapixels_per_second;
+   double iterations_per_second;
+   // The busiest worker's time over the mean; 1 is perfectly balanced.
+   double imbalance;
+   // Relative to the single-threaded run of the same case.
+   double speedup;
+};
+
+const char *precision_name(Precision precision) {
+   switch (precision) {
+   case Precision::float32:
+      return "float";
+   case Precision::double_double:
+      return "double-double";
+   case Precision::automatic:
+   case Precision::float64:
+      break;
+   }
+   return "double";
+}
+
+struct Options {
+   size_t max_threads = Thread_pool::default_num_threads();
+   Thread_placement placement = Thread_placement::floating;
+   size_t repeats = 3;
+   std::string isa;
+   Precision precision = Precision::automatic;
+   bool json = false;
+};
+
+size_t parse_count(const std::string &name, const char *value) {
+   try {
+      size_t pos = 0;
+      // std::stoul takes "-1" as ULONG_MAX; counts start with a digit.
+      if (!std::isdigit(static_cast<unsigned char>(value[0])))
+         throw std::invalid_argument(value);
+      unsigned long result = std::stoul(value, &pos);
+      if (value[pos] == '\0' && result > 0)
+         return result;
+   } catch (const std::logic_error &) {
+   }
+   throw std::runtime_error("Invalid value for " + name + ": " + value);
+}
+
+Options parse_options(int argc, char *argv[]) {
+   Options options;
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--threads" && i + 1 < argc)
+         options.max_threads = parse_count(arg, argv[++i]);
+      else if (arg == "--repeats" && i + 1 < argc)
+         options.repeats = parse_count(arg, argv[++i]);
+      else if (arg == "--pin-threads")
+         options.placement = Thread_placement::pinned;
+      else if (arg == "--isa" && i + 1 < argc)
+         options.isa = argv[++i];
+      else if (arg == "--precision" && i + 1 < argc)
+         options.precision = parse_precision(argv[++i]);
+      else if (arg == "--format" && i + 1 < argc) {
+         std::string format = argv[++i];
+         if (format != "csv" && format != "json")
+            throw std::runtime_error("Unknown format: " + format);
+         options.json = format == "json";
+      } else
+         throw std::runtime_error("Unrecognised argument: " + arg);
+   }
+   if (options.max_threads > Thread_pool::max_threads)
+      throw std::runtime_error("--threads must be at most " +
+                               std::to_string(Thread_pool::max_threads));
+   return options;
+}
+
+// 1, 2, 4... up to and including max_threads.
+std::vector<size_t> thread_counts(size_t max_threads) {
+   std::vector<size_t> counts;
+   for (size_t n = 1; n < max_threads; n *= 2)
+      counts.push_back(n);
+   counts.push_back(max_threads);
+   return counts;
+}
+
+void print_csv(const std::vector<Result> &results) {
+   std::cout << "case,isa,precision,width,height,max_iter,frames,threads,"
+                "seconds,megapixels_per_s,iterations_per_s,imbalance,"
+                "speedup\n";
+   for (const Result &r : results)
+      std::cout << r.bench->name << ',' << escape_time_isa() << ','
+                << r.precision << ',' << r.bench->width << ','
+                << r.bench->height << ',' << r.bench->max_iter << ','
+                << r.bench->times.size() << ',' << r.threads << ','
+                << r.seconds << ',' << r.megapixels_per_second << ','
+                << r.iterations_per_second << ',' << r.imbalance << ','
+                << r.speedup << '\n';
+}
+
+void print_json(const std::vector<Result> &results) {
+   std::cout << "{\"isa\": \"" << escape_time_isa() << "\", \"results\": [";
+   for (size_t k = 0; k < results.size(); ++k) {
+      const Result &r = results[k];
+      std::cout << (k == 0 ? "\n" : ",\n") << "  {\"case\": \""
+                << r.bench->name << "\", \"precision\": \"" << r.precision
+                << "\", \"width\": " << r.bench->width
+                << ", \"height\": " << r.bench->height
+                << ", \"max_iter\": " << r.bench->max_iter
+                << ", \"frames\": " << r.bench->times.size()
+                << ", \"threads\": " << r.threads
+                << ", \"seconds\": " << r.seconds
+                << ", \"megapixels_per_s\": " << r.megapixels_per_second
+                << ", \"iterations_per_s\": " << r.iterations_per_second
+                << ", \"imbalance\": " << r.imbalance
+                << ", \"speedup\": " << r.speedup << "}";
+   }
+   std::cout << "\n]}\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+   try {
+      Options options = parse_options(argc, argv);
+      if (!options.isa.empty())
+         select_escape_time_isa(options.isa);
+
+      std::vector<Bench_case> cases = bench_cases();
+      std::vector<size_t> counts = thread_counts(options.max_threads);
+      std::vector<Result> results;
+      for (const Bench_case &bench : cases) {
+         Render_settings settings{
+             Render_method::brute_force, bench.viewport, bench.max_iter,
+             resolve_precision(options.precision, bench.viewport,
+                               bench.width, bench.height)};
+         double iterations = 0;
+         double single_thread_seconds = 0;
+         for (size_t threads : counts) {
+            Thread_pool pool(threads, options.placement);
+            if (iterations == 0)
+               iterations = total_iterations(pool, bench, settings);
+            Measurement best = measure(pool, bench, settings);
+            for (size_t k = 1; k < options.repeats; ++k) {
+               Measurement m = measure(pool, bench, settings);
+               if (m.seconds < best.seconds)
+                  best = m;
+            }
+            if (threads == 1)
+               single_thread_seconds = best.seconds;
+
+            double pixels = static_cast<double>(bench.width * bench.height *
+                                                bench.times.size());
+            double busiest =
+                *std::max_element(best.busy.begin(), best.busy.end());
+            double mean =
+                std::accumulate(best.busy.begin(), best.busy.end(), 0.0) /
+                static_cast<double>(best.busy.size());
+            results.push_back({&bench, precision_name(settings.precision),
+                               threads, best.seconds,
+                               pixels / best.seconds * 1e-6,
+                               iterations / best.seconds,
+                               mean > 0 ? busiest / mean : 1.0,
+                               single_thread_seconds / best.seconds});
+         }
+      }
+      if (options.json)
+         print_json(results);
+      else
+         print_csv(results);
+   } catch (const std::runtime_error &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,86 @@
+#include "cpu_topology.h"
+
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef FRACTALS_HAVE_AFFINITY
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+std::string read_line(const std::string &path) {
+   std::ifstream file(path);
+   std::string line;
+   std::getline(file, line);
+   return line;
+}
+
+// Parses a sysfs list of CPUs or nodes, such as "0-3,8,10-11".
+std::vector<int> parse_cpu_list(const std::string &list) {
+   std::vector<int> cpus;
+   std::istringstream ranges(list);
+   std::string range;
+   while (std::getline(ranges, range, ',')) {
+      size_t dash = range.find('-');
+      try {
+         int first = std::stoi(range.substr(0, dash));
+         int last = dash == std::string::npos
+                        ? first
+                        : std::stoi(range.substr(dash + 1));
+         for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+      } catch (const std::exception &) {
+         return {};
+      }
+   }
+   return cpus;
+}
+
+} // namespace
+
+std::vector<std::vector<int>> numa_cpus() {
+#ifdef FRACTALS_HAVE_AFFINITY
+   cpu_set_t allowed;
+   CPU_ZERO(&allowed);
+   if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+      return {};
+   std::vector<std::vector<int>> nodes;
+   const std::string sysfs = "/sys/devices/system/node/";
+   for (int node : parse_cpu_list(read_line(sysfs + "online"))) {
+      std::vector<int> cpus;
+      for (int cpu : parse_cpu_list(read_line(
+               sysfs + "node" + std::to_string(node) + "/cpulist")))
+         if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+            cpus.push_back(cpu);
+      if (!cpus.empty())
+         nodes.push_back(cpus);
+   }
+   if (nodes.empty()) {
+      nodes.emplace_back();
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+         if (CPU_ISSET(cpu, &allowed))
+            nodes.back().push_back(cpu);
+   }
+   return nodes;
+#else
+   return {};
+#endif
+}
+
+bool pin_thread(std::thread &thread, int cpu) {
+#ifdef FRACTALS_HAVE_AFFINITY
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   CPU_SET(cpu, &set);
+   return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) ==
+          0;
+#else
+   (void)thread;
+   (void)cpu;
+   return false;
+#endif
+}
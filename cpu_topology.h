@@ -0,0 +1,14 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+
+// The CPUs this process may run on, grouped by NUMA node in node order,
+// as Linux lists them under /sys/devices/system/node. Elsewhere, or where
+// that cannot be read, one group of every allowed CPU; empty where those
+// cannot be told either.
+std::vector<std::vector<int>> numa_cpus();
+
+// Restricts thread to cpu. Returns false where that is not supported or is
+// refused.
+bool pin_thread(std::thread &thread, int cpu);
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+// An unevaluated sum of two doubles, giving about 32 significant decimal
+// digits. Used where double runs out of precision, such as the centre of a
+// deeply zoomed view.
+struct Double_double {
+   double hi;
+   double lo;
+
+   Double_double() : hi(0), lo(0) {}
+   Double_double(double x) : hi(x), lo(0) {}
+   Double_double(double h, double l) : hi(h), lo(l) {}
+
+   explicit operator double() const { return hi + lo; }
+};
+
+inline Double_double quick_two_sum(double a, double b) {
+   double s = a + b;
+   return {s, b - (s - a)};
+}
+
+inline Double_double two_sum(double a, double b) {
+   double s = a + b;
+   double v = s - a;
+   return {s, (a - (s - v)) + (b - v)};
+}
+
+inline Double_double two_prod(double a, double b) {
+   double p = a * b;
+   return {p, std::fma(a, b, -p)};
+}
+
+inline Double_double operator+(Double_double a, Double_double b) {
+   Double_double s = two_sum(a.hi, b.hi);
+   Double_double t = two_sum(a.lo, b.lo);
+   s = quick_two_sum(s.hi, s.lo + t.hi);
+   return quick_two_sum(s.hi, s.lo + t.lo);
+}
+
+inline Double_double operator-(Double_double a) { return {-a.hi, -a.lo}; }
+
+inline Double_double operator-(Double_double a, Double_double b) {
+   return a + (-b);
+}
+
+inline Double_double operator*(Double_double a, Double_double b) {
+   Double_double p = two_prod(a.hi, b.hi);
+   return quick_two_sum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+inline Double_double operator/(Double_double a, double b) {
+   double q1 = a.hi / b;
+   Double_double r = a - two_prod(q1, b);
+   double q2 = r.hi / b;
+   r = r - two_prod(q2, b);
+   return quick_two_sum(q1, q2) + r.hi / b;
+}
+
+inline bool operator==(Double_double a, Double_double b) {
+   return a.hi == b.hi && a.lo == b.lo;
+}
+
+inline bool operator<(Double_double a, Double_double b) {
+   return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+inline bool operator<=(Double_double a, Double_double b) { return !(b < a); }
+
+// Parses a decimal number such as "-0.74364388703715870475219150611477",
+// keeping all the digits a Double_double can hold.
+inline Double_double parse_double_double(const std::string &text) {
+   size_t pos = 0;
+   bool negative = false;
+   if (pos < text.size() && (text[pos] == '-' || text[pos] == '+'))
+      negative = text[pos++] == '-';
+   Double_double value;
+   int exponent = 0;
+   bool digits = false;
+   bool fraction = false;
+   for (; pos < text.size(); ++pos) {
+      char ch = text[pos];
+      if (ch == '.' && !fraction) {
+         fraction = true;
+      } else if (std::isdigit(static_cast<unsigned char>(ch))) {
+         value = value * 10.0 + static_cast<double>(ch - '0');
+         digits = true;
+         if (fraction)
+            --exponent;
+      } else {
+         break;
+      }
+   }
+   if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+      try {
+         size_t used = 0;
+         exponent += std::stoi(text.substr(pos + 1), &used);
+         pos += used + 1;
+      } catch (const std::logic_error &) {
+         digits = false;
+      }
+   }
+   if (!digits || pos != text.size())
+      throw std::runtime_error("Invalid number: " + text);
+   for (; exponent > 0; --exponent)
+      value = value * 10.0;
+   for (; exponent < 0; ++exponent)
+      value = value / 10.0;
+   return negative ? -value : value;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The escape_time() results for a whole image, kept apart from any colouring
+// so that an image can be recoloured without iterating it again. Pixel (x, y)
+// is at index y * width + x of each plane.
+struct Escape_buffer {
+   size_t width = 0;
+   size_t height = 0;
+   // No pixel has more iterations than this.
+   uint32_t max_iter = 0;
+   std::vector<uint32_t> iterations;
+   std::vector<float> norms;
+
+   Escape_buffer() = default;
+   Escape_buffer(size_t w, size_t h, uint32_t limit)
+       : width(w), height(h), max_iter(limit), iterations(w * h),
+         norms(w * h) {}
+};
+
+// The planes of escape times, held by an Escape_buffer or mapped from a
+// file, for code that only reads them. It does not own the planes.
+struct Escape_planes {
+   size_t width;
+   size_t height;
+   uint32_t max_iter;
+   const uint32_t *iterations;
+   const float *norms;
+
+   Escape_planes(size_t w, size_t h, uint32_t limit, const uint32_t *i,
+                 const float *n)
+       : width(w), height(h), max_iter(limit), iterations(i), norms(n) {}
+   Escape_planes(const Escape_buffer &buffer)
+       : Escape_planes(buffer.width, buffer.height, buffer.max_iter,
+                       buffer.iterations.data(), buffer.norms.data()) {}
+};
+
+// A final |z|^2 stored as a float, rounded so that it still exceeds 4
+// exactly when the double did: a float is ample for colouring, but must not
+// move a point across the escape radius.
+inline float compact_norm(double norm) {
+   float compact = static_cast<float>(norm);
+   if (norm > 4.0 && !(compact > 4.0f))
+      compact = std::nextafter(4.0f, 5.0f);
+   return compact;
+}
+
+// The continuous escape count of an escaped point: its whole count less the
+// fraction of the last iteration it needed to pass |z| = 2, which runs
+// smoothly from one count to the next across the image. degree is that of
+// the formula iterated; see formula_degree(). Never below 0, so that a point
+// escaping at once still indexes a palette.
+inline double smooth_iterations(uint32_t iterations, float norm,
+                                int degree = 2) {
+   double part = std::log2(std::log2(static_cast<double>(norm))) - 1.0;
+   if (degree != 2)
+      part /= std::log2(static_cast<double>(degree));
+   return std::max(0.0, static_cast<double>(iterations) -
+                            std::max(0.0, std::min(part, 1.0)));
+}
+
+// Stores count results from escape_time() at offset in the buffer.
+inline void store_escape(Escape_buffer &buffer, size_t offset,
+                         const int *iterations, const double *norms,
+                         size_t count) {
+   for (size_t k = 0; k < count; ++k) {
+      buffer.iterations[offset + k] = static_cast<uint32_t>(iterations[k]);
+      buffer.norms[offset + k] = compact_norm(norms[k]);
+   }
+}
@@ -0,0 +1,180 @@
+#include "escape_file.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef FRACTALS_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char escape_magic[8] = {'F', 'R', 'E', 'S', 'C', 'A', 'P', 'E'};
+constexpr uint32_t escape_version = 1;
+// Reads back as another value on a machine of the other byte order.
+constexpr uint32_t byte_order_mark = 0x01020304;
+// Planes start on multiples of this, so that each maps from its own pages.
+constexpr uint64_t plane_alignment = 4096;
+
+struct File_header {
+   char magic[8];
+   uint32_t version;
+   uint32_t byte_order;
+   uint64_t width;
+   uint64_t height;
+   uint32_t max_iter;
+   uint32_t fractal;
+   uint32_t precision;
+   uint32_t formula;
+   double c_re;
+   double c_im;
+   double centre_re_hi;
+   double centre_re_lo;
+   double centre_im_hi;
+   double centre_im_lo;
+   double half_width;
+   double half_height;
+   // From the start of the file.
+   uint64_t iterations_offset;
+   uint64_t norms_offset;
+};
+
+static_assert(sizeof(File_header) == 128, "File_header must not be padded");
+
+uint64_t aligned(uint64_t offset) {
+   return (offset + plane_alignment - 1) / plane_alignment * plane_alignment;
+}
+
+} // namespace
+
+void write_escape_file(const std::string &path, const Escape_file_info &info,
+                       const Escape_buffer &escape) {
+   uint64_t plane = escape.width * escape.height;
+   File_header header{};
+   std::memcpy(header.magic, escape_magic, sizeof(escape_magic));
+   header.version = escape_version;
+   header.byte_order = byte_order_mark;
+   header.width = escape.width;
+   header.height = escape.height;
+   header.max_iter = escape.max_iter;
+   header.fractal = static_cast<uint32_t>(info.fractal.type);
+   header.precision = static_cast<uint32_t>(info.precision);
+   header.formula = static_cast<uint32_t>(info.fractal.formula);
+   header.c_re = info.fractal.c.real();
+   header.c_im = info.fractal.c.imag();
+   header.centre_re_hi = info.viewport.centre_re.hi;
+   header.centre_re_lo = info.viewport.centre_re.lo;
+   header.centre_im_hi = info.viewport.centre_im.hi;
+   header.centre_im_lo = info.viewport.centre_im.lo;
+   header.half_width = info.viewport.half_width;
+   header.half_height = info.viewport.half_height;
+   header.iterations_offset = aligned(sizeof(header));
+   header.norms_offset =
+       aligned(header.iterations_offset + plane * sizeof(uint32_t));
+
+   std::ofstream file(path, std::ios::binary);
+   std::vector<char> padding(plane_alignment);
+   file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+   file.write(padding.data(), static_cast<std::streamsize>(
+                                  header.iterations_offset - sizeof(header)));
+   file.write(reinterpret_cast<const char *>(escape.iterations.data()),
+              static_cast<std::streamsize>(plane * sizeof(uint32_t)));
+   file.write(padding.data(),
+              static_cast<std::streamsize>(
+                  header.norms_offset - header.iterations_offset -
+                  plane * sizeof(uint32_t)));
+   file.write(reinterpret_cast<const char *>(escape.norms.data()),
+              static_cast<std::streamsize>(plane * sizeof(float)));
+   file.close();
+   if (!file)
+      throw std::runtime_error("Failed to write " + path);
+}
+
+Mapped_escape_file::Mapped_escape_file(const std::string &path) {
+#ifdef FRACTALS_HAVE_MMAP
+   int fd = open(path.c_str(), O_RDONLY);
+   struct stat status;
+   if (fd < 0 || fstat(fd, &status) != 0) {
+      if (fd >= 0)
+         close(fd);
+      throw std::runtime_error("Cannot read " + path);
+   }
+   size_ = static_cast<size_t>(status.st_size);
+   void *mapping = size_ == 0 ? MAP_FAILED
+                              : mmap(nullptr, size_, PROT_READ, MAP_PRIVATE,
+                                     fd, 0);
+   close(fd);
+   if (mapping == MAP_FAILED)
+      throw std::runtime_error("Cannot map " + path);
+   data_ = static_cast<const unsigned char *>(mapping);
+#else
+   std::ifstream file(path, std::ios::binary);
+   if (!file)
+      throw std::runtime_error("Cannot read " + path);
+   copy_.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+   data_ = copy_.data();
+   size_ = copy_.size();
+#endif
+
+   // Only the header is checked, so that pages are still read only as they
+   // are touched. Counts in the planes past max_iter are clamped by
+   // whatever colours them.
+   File_header header;
+   bool valid = size_ >= sizeof(header);
+   if (valid)
+      std::memcpy(&header, data_, sizeof(header));
+   uint64_t plane = valid ? header.width * header.height : 0;
+   valid = valid &&
+           std::memcmp(header.magic, escape_magic, sizeof(escape_magic)) ==
+               0 &&
+           header.version == escape_version &&
+           header.byte_order == byte_order_mark && header.width != 0 &&
+           header.height != 0 && header.width >> 32 == 0 &&
+           header.height >> 32 == 0 && header.max_iter != 0 &&
+           header.max_iter >> 31 == 0 &&
+           header.fractal <= static_cast<uint32_t>(Fractal_type::julia) &&
+           header.precision <=
+               static_cast<uint32_t>(Precision::double_double) &&
+           header.formula < static_cast<uint32_t>(formula_count) &&
+           header.iterations_offset >= sizeof(header) &&
+           header.iterations_offset % plane_alignment == 0 &&
+           header.norms_offset % plane_alignment == 0 &&
+           header.iterations_offset <= size_ && header.norms_offset <= size_ &&
+           plane <= (size_ - header.iterations_offset) / sizeof(uint32_t) &&
+           plane <= (size_ - header.norms_offset) / sizeof(float);
+   if (!valid) {
+      unmap();
+      throw std::runtime_error("Not an escape file: " + path);
+   }
+
+   info_.fractal = {static_cast<Fractal_type>(header.fractal),
+                    {header.c_re, header.c_im},
+                    static_cast<int>(header.max_iter),
+                    static_cast<Formula>(header.formula)};
+   info_.viewport = {{header.centre_re_hi, header.centre_re_lo},
+                     {header.centre_im_hi, header.centre_im_lo},
+                     header.half_width,
+                     header.half_height};
+   info_.precision = static_cast<Precision>(header.precision);
+   planes_ = Escape_planes(
+       header.width, header.height, header.max_iter,
+       reinterpret_cast<const uint32_t *>(data_ + header.iterations_offset),
+       reinterpret_cast<const float *>(data_ + header.norms_offset));
+}
+
+Mapped_escape_file::~Mapped_escape_file() { unmap(); }
+
+void Mapped_escape_file::unmap() {
+#ifdef FRACTALS_HAVE_MMAP
+   if (data_ != nullptr)
+      munmap(const_cast<unsigned char *>(data_), size_);
+   data_ = nullptr;
+#endif
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "escape_buffer.h"
+#include "escape_time.h"
+#include "viewport.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// What an escape file was rendered from.
+struct Escape_file_info {
+   Fractal fractal;
+   Viewport viewport;
+   Precision precision;
+};
+
+// Writes escape to path as an escape file: a fixed header giving info and
+// the size, then the iteration and norm planes exactly as an Escape_buffer
+// holds them, each starting on a page boundary. Values are stored in native
+// byte order, and files from a machine of another order are refused.
+// Throws std::runtime_error if writing fails.
+void write_escape_file(const std::string &path, const Escape_file_info &info,
+                       const Escape_buffer &escape);
+
+// An escape file mapped read-only into memory, so that its planes are used
+// in place rather than read or copied; pages are loaded as they are first
+// touched. Throws std::runtime_error for a file that cannot be read or is
+// not a valid escape file.
+class Mapped_escape_file {
+ public:
+   explicit Mapped_escape_file(const std::string &path);
+   ~Mapped_escape_file();
+
+   Mapped_escape_file(const Mapped_escape_file &) = delete;
+   Mapped_escape_file &operator=(const Mapped_escape_file &) = delete;
+
+   const Escape_file_info &info() const { return info_; }
+   // Valid as long as the file stays mapped.
+   const Escape_planes &planes() const { return planes_; }
+
+ private:
+   void unmap();
+
+   const unsigned char *data_ = nullptr;
+   size_t size_ = 0;
+   // The file's contents where it cannot be mapped.
+   std::vector<unsigned char> copy_;
+   Escape_file_info info_;
+   Escape_planes planes_{0, 0, 0, nullptr, nullptr};
+};
@@ -0,0 +1,179 @@
+#include "escape_render.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+Render_method parse_render_method(const std::string &name) {
+   if (name == "brute")
+      return Render_method::brute_force;
+   if (name == "subdivide")
+      return Render_method::subdivide;
+   throw std::runtime_error("Unknown render method: " + name);
+}
+
+namespace {
+
+template <typename Float_type>
+void render_brute_force(const Fractal &fractal, size_t width, size_t height,
+                        const Float_type *re, const Float_type *im,
+                        int *iterations, double *norms, size_t stride) {
+   std::vector<Float_type> row_im(width);
+   for (size_t i = 0; i < height; ++i) {
+      std::fill(row_im.begin(), row_im.end(), im[i]);
+      escape_time(fractal, re, row_im.data(), width, iterations + i * stride,
+                  norms + i * stride);
+   }
+}
+
+template <typename Float_type>
+class Subdivision {
+ public:
+   Subdivision(const Fractal &fractal, size_t width, size_t height,
+               const Float_type *re, const Float_type *im, int *iterations,
+               double *norms, size_t stride)
+       : fractal_(fractal), re_(re), im_(im), iterations_(iterations),
+         norms_(norms), stride_(stride), width_(width),
+         known_(width * height, false) {}
+
+   // Renders [x0, x1) x [y0, y1). Neighbouring rectangles share their
+   // common edge, so every pixel is evaluated at most once.
+   void render(size_t x0, size_t y0, size_t x1, size_t y1) {
+      for (size_t j = x0; j < x1; ++j) {
+         request(j, y0);
+         request(j, y1 - 1);
+      }
+      for (size_t i = y0 + 1; i + 1 < y1; ++i) {
+         request(x0, i);
+         request(x1 - 1, i);
+      }
+      flush();
+      if (x1 - x0 <= 2 || y1 - y0 <= 2)
+         return;
+
+      if (uniform_boundary(x0, y0, x1, y1)) {
+         fill(x0 + 1, y0 + 1, x1 - 1, y1 - 1, iterations_[y0 * stride_ + x0],
+              norms_[y0 * stride_ + x0]);
+      } else if ((x1 - x0) * (y1 - y0) <= minimum_area) {
+         for (size_t i = y0 + 1; i + 1 < y1; ++i)
+            for (size_t j = x0 + 1; j + 1 < x1; ++j)
+               request(j, i);
+         flush();
+      } else if (x1 - x0 >= y1 - y0) {
+         size_t mid = (x0 + x1) / 2;
+         render(x0, y0, mid + 1, y1);
+         render(mid, y0, x1, y1);
+      } else {
+         size_t mid = (y0 + y1) / 2;
+         render(x0, y0, x1, mid + 1);
+         render(x0, mid, x1, y1);
+      }
+   }
+
+ private:
+   // Below this many pixels a rectangle is cheaper to iterate than to split.
+   static constexpr size_t minimum_area = 100;
+
+   void request(size_t j, size_t i) {
+      if (known_[i * width_ + j])
+         return;
+      known_[i * width_ + j] = true;
+      pending_.push_back(i * stride_ + j);
+      pending_re_.push_back(re_[j]);
+      pending_im_.push_back(im_[i]);
+   }
+
+   void flush() {
+      size_t count = pending_.size();
+      if (count == 0)
+         return;
+      results_.resize(count);
+      result_norms_.resize(count);
+      escape_time(fractal_, pending_re_.data(), pending_im_.data(), count,
+                  results_.data(), result_norms_.data());
+      for (size_t k = 0; k < count; ++k) {
+         iterations_[pending_[k]] = results_[k];
+         norms_[pending_[k]] = result_norms_[k];
+      }
+      pending_.clear();
+      pending_re_.clear();
+      pending_im_.clear();
+   }
+
+   bool same(size_t offset, int iterations, bool escaped) const {
+      return iterations_[offset] == iterations &&
+             (norms_[offset] > 4.0) == escaped;
+   }
+
+   bool uniform_boundary(size_t x0, size_t y0, size_t x1, size_t y1) const {
+      int iterations = iterations_[y0 * stride_ + x0];
+      bool escaped = norms_[y0 * stride_ + x0] > 4.0;
+      for (size_t j = x0; j < x1; ++j)
+         if (!same(y0 * stride_ + j, iterations, escaped) ||
+             !same((y1 - 1) * stride_ + j, iterations, escaped))
+            return false;
+      for (size_t i = y0 + 1; i + 1 < y1; ++i)
+         if (!same(i * stride_ + x0, iterations, escaped) ||
+             !same(i * stride_ + x1 - 1, iterations, escaped))
+            return false;
+      return true;
+   }
+
+   void fill(size_t x0, size_t y0, size_t x1, size_t y1, int iterations,
+             double norm) {
+      for (size_t i = y0; i < y1; ++i) {
+         for (size_t j = x0; j < x1; ++j) {
+            known_[i * width_ + j] = true;
+            iterations_[i * stride_ + j] = iterations;
+            norms_[i * stride_ + j] = norm;
+         }
+      }
+   }
+
+   const Fractal &fractal_;
+   const Float_type *re_;
+   const Float_type *im_;
+   int *iterations_;
+   double *norms_;
+   size_t stride_;
+   size_t width_;
+   std::vector<bool> known_;
+   std::vector<size_t> pending_;
+   std::vector<Float_type> pending_re_;
+   std::vector<Float_type> pending_im_;
+   std::vector<int> results_;
+   std::vector<double> result_norms_;
+};
+
+} // namespace
+
+template <typename Float_type>
+void render_escape_tile(const Fractal &fractal, Render_method method,
+                        size_t width, size_t height, const Float_type *re,
+                        const Float_type *im, int *iterations, double *norms,
+                        size_t stride) {
+   if (width == 0 || height == 0)
+      return;
+   if (method == Render_method::brute_force) {
+      render_brute_force(fractal, width, height, re, im, iterations, norms,
+                         stride);
+      return;
+   }
+   Subdivision<Float_type> subdivision(fractal, width, height, re, im,
+                                       iterations, norms, stride);
+   subdivision.render(0, 0, width, height);
+}
+
+template void render_escape_tile<float>(const Fractal &, Render_method,
+                                        size_t, size_t, const float *,
+                                        const float *, int *, double *,
+                                        size_t);
+template void render_escape_tile<double>(const Fractal &, Render_method,
+                                         size_t, size_t, const double *,
+                                         const double *, int *, double *,
+                                         size_t);
+template void render_escape_tile<Double_double>(const Fractal &,
+                                                Render_method, size_t, size_t,
+                                                const Double_double *,
+                                                const Double_double *, int *,
+                                                double *, size_t);
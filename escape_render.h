@@ -0,0 +1,28 @@
+#pragma once
+
+#include "escape_time.h"
+
+#include <cstddef>
+#include <string>
+
+enum class Render_method {
+   // Every pixel is iterated.
+   brute_force,
+   // Mariani-Silver subdivision: rectangles whose boundary pixels all share
+   // one escape time are filled without iterating their interior. Much
+   // faster over large uniform regions, but can miss detail that does not
+   // reach a rectangle's boundary.
+   subdivide
+};
+
+Render_method parse_render_method(const std::string &name);
+
+// Computes escape times for a width x height block of pixels, where pixel
+// (j, i) lies at re[j] + im[i] i in the complex plane. Results for that pixel
+// are written to iterations[i * stride + j] and norms[i * stride + j].
+// Instantiated for the same Float_types as escape_time().
+template <typename Float_type>
+void render_escape_tile(const Fractal &fractal, Render_method method,
+                        size_t width, size_t height, const Float_type *re,
+                        const Float_type *im, int *iterations, double *norms,
+                        size_t stride);
@@ -0,0 +1,150 @@
+#include "escape_time.h"
+#include "escape_time_kernel.h"
+
+#include <stdexcept>
+
+#if defined(FRACTALS_HAVE_AVX2)
+Kernel_table avx2_kernels();
+#endif
+#if defined(FRACTALS_HAVE_AVX512)
+Kernel_table avx512_kernels();
+#endif
+#if defined(FRACTALS_HAVE_NEON)
+Kernel_table neon_kernels();
+#endif
+
+namespace {
+
+template <typename T>
+struct Scalar_vector {
+   using Scalar = T;
+   using Mask = bool;
+   static constexpr size_t lanes = 1;
+
+   T v;
+
+   static Scalar_vector load(const T *p) { return {*p}; }
+   static void store(T *p, Scalar_vector a) { *p = a.v; }
+   static Scalar_vector broadcast(T x) { return {x}; }
+   static Mask less(Scalar_vector a, Scalar_vector b) { return a.v < b.v; }
+   static Mask less_equal(Scalar_vector a, Scalar_vector b) {
+      return a.v <= b.v;
+   }
+   static Mask equal(Scalar_vector a, Scalar_vector b) { return a.v == b.v; }
+   static Mask both(Mask m, Mask n) { return m && n; }
+   static Mask either(Mask m, Mask n) { return m || n; }
+   static Mask but_not(Mask m, Mask n) { return m && !n; }
+   static bool any(Mask m) { return m; }
+   static Scalar_vector select(Mask m, Scalar_vector a, Scalar_vector b) {
+      return m ? a : b;
+   }
+
+   Scalar_vector operator+(Scalar_vector b) const { return {v + b.v}; }
+   Scalar_vector operator-(Scalar_vector b) const { return {v - b.v}; }
+   Scalar_vector operator*(Scalar_vector b) const { return {v * b.v}; }
+};
+
+struct Isa_kernel {
+   const char *name;
+   Kernel_table kernels;
+};
+
+std::vector<Isa_kernel> supported_kernels() {
+   std::vector<Isa_kernel> kernels;
+#if defined(FRACTALS_HAVE_AVX512)
+   if (__builtin_cpu_supports("avx512f"))
+      kernels.push_back({"avx512", avx512_kernels()});
+#endif
+#if defined(FRACTALS_HAVE_AVX2)
+   if (__builtin_cpu_supports("avx2"))
+      kernels.push_back({"avx2", avx2_kernels()});
+#endif
+#if defined(FRACTALS_HAVE_NEON)
+   kernels.push_back({"neon", neon_kernels()});
+#endif
+   kernels.push_back(
+       {"scalar",
+        make_kernel_table<Scalar_vector<float>, Scalar_vector<double>>()});
+   return kernels;
+}
+
+Isa_kernel &selected_kernel() {
+   static Isa_kernel kernel = supported_kernels().front();
+   return kernel;
+}
+
+void run_escape_time(const Kernel_table &kernels, const Fractal &fractal,
+                     const float *re, const float *im, size_t count,
+                     int *iterations, double *norms, double *distances) {
+   kernels.escape_time_float[static_cast<int>(fractal.formula)]
+                            [distances != nullptr](fractal, re, im, count,
+                                                   iterations, norms,
+                                                   distances);
+}
+
+void run_escape_time(const Kernel_table &kernels, const Fractal &fractal,
+                     const double *re, const double *im, size_t count,
+                     int *iterations, double *norms, double *distances) {
+   kernels.escape_time_double[static_cast<int>(fractal.formula)]
+                             [distances != nullptr](fractal, re, im, count,
+                                                    iterations, norms,
+                                                    distances);
+}
+
+// No SIMD unit has double-double lanes, so every ISA shares the scalar loop.
+void run_escape_time(const Kernel_table &, const Fractal &fractal,
+                     const Double_double *re, const Double_double *im,
+                     size_t count, int *iterations, double *norms,
+                     double *distances) {
+   escape_time_variant<Scalar_vector<Double_double>>(
+       fractal.formula, distances != nullptr)(fractal, re, im, count,
+                                              iterations, norms, distances);
+}
+
+} // namespace
+
+template <typename Float_type>
+void escape_time(const Fractal &fractal, const Float_type *re,
+                 const Float_type *im, size_t count, int *iterations,
+                 double *norms, double *distances) {
+   run_escape_time(selected_kernel().kernels, fractal, re, im, count,
+                   iterations, norms, distances);
+}
+
+template void escape_time<float>(const Fractal &, const float *,
+                                 const float *, size_t, int *, double *,
+                                 double *);
+template void escape_time<double>(const Fractal &, const double *,
+                                  const double *, size_t, int *, double *,
+                                  double *);
+template void escape_time<Double_double>(const Fractal &,
+                                         const Double_double *,
+                                         const Double_double *, size_t,
+                                         int *, double *, double *);
+
+void perturbed_escape_time(const Perturbation &perturbation,
+                           const double *dc_re, const double *dc_im,
+                           size_t count, int *iterations, double *norms,
+                           uint8_t *glitched) {
+   selected_kernel().kernels.perturbed(perturbation, dc_re, dc_im, count,
+                                       iterations, norms, glitched);
+}
+
+std::vector<std::string> escape_time_isas() {
+   std::vector<std::string> names;
+   for (const Isa_kernel &kernel : supported_kernels())
+      names.push_back(kernel.name);
+   return names;
+}
+
+const char *escape_time_isa() { return selected_kernel().name; }
+
+void select_escape_time_isa(const std::string &name) {
+   for (const Isa_kernel &kernel : supported_kernels()) {
+      if (name == kernel.name) {
+         selected_kernel() = kernel;
+         return;
+      }
+   }
+   throw std::runtime_error("Unsupported escape-time kernel: " + name);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "double_double.h"
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class Fractal_type { mandelbrot, julia };
+
+// The map iterated, each plus c: z^2, z^3, z^4, the Burning Ship's
+// (|Re z| + |Im z| i)^2 and the Tricorn's conj(z)^2.
+enum class Formula { z2, z3, z4, burning_ship, tricorn };
+
+constexpr int formula_count = 5;
+
+// How fast |z| grows once large: the exponent of the formula.
+inline int formula_degree(Formula formula) {
+   return formula == Formula::z3 ? 3 : formula == Formula::z4 ? 4 : 2;
+}
+
+struct Fractal {
+   Fractal_type type;
+   // The constant added on every iteration of a Julia set; unused for the
+   // Mandelbrot set, where each point supplies its own.
+   std::complex<double> c;
+   int max_iter;
+   Formula formula = Formula::z2;
+};
+
+// Iterates z -> z^2 + c, or the map fractal.formula names, for count points
+// given as separate real and imaginary arrays, stopping each point once
+// |z| >= 2 or after max_iter iterations. Writes the number of iterations
+// performed and the final |z|^2 of each point; a point escaped if its final
+// |z|^2 is greater than 4. Points recognised early as lying inside the set
+// report max_iter iterations and a final |z|^2 of at most 4, exactly as if
+// they had been iterated to the limit.
+//
+// If distances is given, each escaped point also gets the exterior distance
+// estimate |z| ln|z| / (2 |dz|), where dz is the derivative of z with
+// respect to c for the Mandelbrot set or to the starting point for a Julia
+// set: roughly its distance from the set in the plane's units. Points that
+// did not escape, and those whose derivative overflowed, get 0. The Burning
+// Ship and the Tricorn have no complex derivative; theirs is taken through
+// the square each step reduces to, and gives a rougher estimate.
+//
+// Every formula, with and without distances, has a loop of its own, chosen
+// once per call. The work is done by the widest SIMD kernel the CPU
+// supports, in the precision of Float_type: float, double or Double_double.
+// A float vector holds twice as many points as a double vector, while
+// Double_double has no SIMD support and is many times slower than either.
+template <typename Float_type>
+void escape_time(const Fractal &fractal, const Float_type *re,
+                 const Float_type *im, size_t count, int *iterations,
+                 double *norms, double *distances = nullptr);
+
+// What the per-pixel loop of a perturbation render needs to know about its
+// reference orbit; see perturbation.h.
+struct Perturbation {
+   // The reference orbit Z_0, Z_1, ... Z_(length - 1).
+   const double *orbit_re;
+   const double *orbit_im;
+   size_t length;
+   // The iteration at which pixels start, and the series approximation
+   // coefficients for that iteration: delta = a dc + b dc^2 + c dc^3.
+   int start;
+   std::complex<double> a;
+   std::complex<double> b;
+   std::complex<double> c;
+   int max_iter;
+};
+
+// Iterates the offsets delta_(n+1) = 2 Z_n delta_n + delta_n^2 + dc of count
+// points from the reference orbit, where the points lie at dc_re + dc_im i
+// relative to the reference. Writes iterations and norms as escape_time()
+// does. Sets glitched for points whose result cannot be trusted, either
+// because delta grew too large relative to the orbit or because the orbit
+// escaped before the point did; those must be rendered again from a
+// different reference.
+void perturbed_escape_time(const Perturbation &perturbation,
+                           const double *dc_re, const double *dc_im,
+                           size_t count, int *iterations, double *norms,
+                           uint8_t *glitched);
+
+// Names of the kernels usable on this CPU, widest first.
+std::vector<std::string> escape_time_isas();
+
+const char *escape_time_isa();
+
+// Forces a particular kernel; throws std::runtime_error if it is unknown or
+// not supported by this CPU.
+void select_escape_time_isa(const std::string &name);
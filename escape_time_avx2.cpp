@@ -0,0 +1,81 @@
+#include "escape_time_kernel.h"
+
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2_float {
+   using Scalar = float;
+   using Mask = __m256;
+   static constexpr size_t lanes = 8;
+
+   __m256 v;
+
+   static Avx2_float load(const float *p) { return {_mm256_loadu_ps(p)}; }
+   static void store(float *p, Avx2_float a) { _mm256_storeu_ps(p, a.v); }
+   static Avx2_float broadcast(float x) { return {_mm256_set1_ps(x)}; }
+   static Mask less(Avx2_float a, Avx2_float b) {
+      return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ);
+   }
+   static Mask less_equal(Avx2_float a, Avx2_float b) {
+      return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ);
+   }
+   static Mask equal(Avx2_float a, Avx2_float b) {
+      return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ);
+   }
+   static Mask both(Mask m, Mask n) { return _mm256_and_ps(m, n); }
+   static Mask either(Mask m, Mask n) { return _mm256_or_ps(m, n); }
+   static Mask but_not(Mask m, Mask n) { return _mm256_andnot_ps(n, m); }
+   static bool any(Mask m) { return _mm256_movemask_ps(m) != 0; }
+   static Avx2_float select(Mask m, Avx2_float a, Avx2_float b) {
+      return {_mm256_blendv_ps(b.v, a.v, m)};
+   }
+
+   Avx2_float operator+(Avx2_float b) const { return {_mm256_add_ps(v, b.v)}; }
+   Avx2_float operator-(Avx2_float b) const { return {_mm256_sub_ps(v, b.v)}; }
+   Avx2_float operator*(Avx2_float b) const { return {_mm256_mul_ps(v, b.v)}; }
+};
+
+struct Avx2_double {
+   using Scalar = double;
+   using Mask = __m256d;
+   static constexpr size_t lanes = 4;
+
+   __m256d v;
+
+   static Avx2_double load(const double *p) { return {_mm256_loadu_pd(p)}; }
+   static void store(double *p, Avx2_double a) { _mm256_storeu_pd(p, a.v); }
+   static Avx2_double broadcast(double x) { return {_mm256_set1_pd(x)}; }
+   static Mask less(Avx2_double a, Avx2_double b) {
+      return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ);
+   }
+   static Mask less_equal(Avx2_double a, Avx2_double b) {
+      return _mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ);
+   }
+   static Mask equal(Avx2_double a, Avx2_double b) {
+      return _mm256_cmp_pd(a.v, b.v, _CMP_EQ_OQ);
+   }
+   static Mask both(Mask m, Mask n) { return _mm256_and_pd(m, n); }
+   static Mask either(Mask m, Mask n) { return _mm256_or_pd(m, n); }
+   static Mask but_not(Mask m, Mask n) { return _mm256_andnot_pd(n, m); }
+   static bool any(Mask m) { return _mm256_movemask_pd(m) != 0; }
+   static Avx2_double select(Mask m, Avx2_double a, Avx2_double b) {
+      return {_mm256_blendv_pd(b.v, a.v, m)};
+   }
+
+   Avx2_double operator+(Avx2_double b) const {
+      return {_mm256_add_pd(v, b.v)};
+   }
+   Avx2_double operator-(Avx2_double b) const {
+      return {_mm256_sub_pd(v, b.v)};
+   }
+   Avx2_double operator*(Avx2_double b) const {
+      return {_mm256_mul_pd(v, b.v)};
+   }
+};
+
+} // namespace
+
+Kernel_table avx2_kernels() {
+   return make_kernel_table<Avx2_float, Avx2_double>();
+}
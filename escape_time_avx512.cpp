@@ -0,0 +1,87 @@
+#include "escape_time_kernel.h"
+
+#include <immintrin.h>
+
+namespace {
+
+struct Avx512_float {
+   using Scalar = float;
+   using Mask = __mmask16;
+   static constexpr size_t lanes = 16;
+
+   __m512 v;
+
+   static Avx512_float load(const float *p) { return {_mm512_loadu_ps(p)}; }
+   static void store(float *p, Avx512_float a) { _mm512_storeu_ps(p, a.v); }
+   static Avx512_float broadcast(float x) { return {_mm512_set1_ps(x)}; }
+   static Mask less(Avx512_float a, Avx512_float b) {
+      return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ);
+   }
+   static Mask less_equal(Avx512_float a, Avx512_float b) {
+      return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ);
+   }
+   static Mask equal(Avx512_float a, Avx512_float b) {
+      return _mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ);
+   }
+   static Mask both(Mask m, Mask n) { return m & n; }
+   static Mask either(Mask m, Mask n) { return m | n; }
+   static Mask but_not(Mask m, Mask n) { return m & ~n; }
+   static bool any(Mask m) { return m != 0; }
+   static Avx512_float select(Mask m, Avx512_float a, Avx512_float b) {
+      return {_mm512_mask_blend_ps(m, b.v, a.v)};
+   }
+
+   Avx512_float operator+(Avx512_float b) const {
+      return {_mm512_add_ps(v, b.v)};
+   }
+   Avx512_float operator-(Avx512_float b) const {
+      return {_mm512_sub_ps(v, b.v)};
+   }
+   Avx512_float operator*(Avx512_float b) const {
+      return {_mm512_mul_ps(v, b.v)};
+   }
+};
+
+struct Avx512_double {
+   using Scalar = double;
+   using Mask = __mmask8;
+   static constexpr size_t lanes = 8;
+
+   __m512d v;
+
+   static Avx512_double load(const double *p) { return {_mm512_loadu_pd(p)}; }
+   static void store(double *p, Avx512_double a) { _mm512_storeu_pd(p, a.v); }
+   static Avx512_double broadcast(double x) { return {_mm512_set1_pd(x)}; }
+   static Mask less(Avx512_double a, Avx512_double b) {
+      return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ);
+   }
+   static Mask less_equal(Avx512_double a, Avx512_double b) {
+      return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LE_OQ);
+   }
+   static Mask equal(Avx512_double a, Avx512_double b) {
+      return _mm512_cmp_pd_mask(a.v, b.v, _CMP_EQ_OQ);
+   }
+   static Mask both(Mask m, Mask n) { return m & n; }
+   static Mask either(Mask m, Mask n) { return m | n; }
+   static Mask but_not(Mask m, Mask n) { return m & ~n; }
+   static bool any(Mask m) { return m != 0; }
+   static Avx512_double select(Mask m, Avx512_double a, Avx512_double b) {
+      return {_mm512_mask_blend_pd(m, b.v, a.v)};
+   }
+
+   Avx512_double operator+(Avx512_double b) const {
+      return {_mm512_add_pd(v, b.v)};
+   }
+   Avx512_double operator-(Avx512_double b) const {
+      return {_mm512_sub_pd(v, b.v)};
+   }
+   Avx512_double operator*(Avx512_double b) const {
+      return {_mm512_mul_pd(v, b.v)};
+   }
+};
+
+} // namespace
+
+Kernel_table avx512_kernels() {
+   return make_kernel_table<Avx512_float, Avx512_double>();
+}
@@ -0,0 +1,462 @@
+#pragma once
+
+#include "escape_time.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// The escape-time loop, written once against a small vector interface and
+// instantiated by each ISA-specific translation unit. V must provide:
+//
+//   V::Scalar                        the type in each lane
+//   V::lanes                         number of lanes per vector
+//   V::Mask                          per-lane boolean
+//   V::load(p), V::store(p, v)       unaligned load and store
+//   V::broadcast(x)                  all lanes set to x
+//   V::less(a, b)                    a < b
+//   V::less_equal(a, b)              a <= b
+//   V::equal(a, b)                   a == b
+//   V::both(m, n)                    m && n
+//   V::either(m, n)                  m || n
+//   V::but_not(m, n)                 m && !n
+//   V::any(m)                        true if any lane of m is set
+//   V::select(m, a, b)               m ? a : b
+//   a + b, a - b, a * b
+//
+// Vector types must live in an anonymous namespace so that every
+// instantiation of this template gets internal linkage and code built for one
+// ISA can never be picked up by the linker for another.
+
+// The distance estimate written by escape_time() for a point with final
+// |z|^2 norm and |dz|^2 derivative.
+inline double exterior_distance(double norm, double derivative) {
+   if (!(norm > 4.0) || !(derivative > 0.0))
+      return 0.0;
+   double distance = 0.25 * std::log(norm) * std::sqrt(norm / derivative);
+   return std::isfinite(distance) ? distance : 0.0;
+}
+
+// Mandelbrot points in the main cardioid or the period-2 bulb never escape,
+// and are found analytically rather than by iterating.
+template <typename V>
+typename V::Mask in_cardioid_or_bulb(V x, V y) {
+   const V quarter = V::broadcast(0.25);
+   const V one = V::broadcast(1.0);
+   V y2 = y * y;
+   V xq = x - quarter;
+   V q = xq * xq + y2;
+   V x1 = x + one;
+   return V::either(V::less_equal(q * (q + xq), quarter * y2),
+                    V::less_equal(x1 * x1 + y2, V::broadcast(0.0625)));
+}
+
+template <typename V>
+V absolute(V x) {
+   const V zero = V::broadcast(0.0);
+   return V::select(V::less(x, zero), zero - x, x);
+}
+
+// One iteration of each formula, short of adding c. power() is the formula
+// applied to z and derivative() its derivative at z times dz, both given
+// the squares zr2 and zi2 of z's parts.
+template <Formula formula>
+struct Formula_step;
+
+template <>
+struct Formula_step<Formula::z2> {
+   template <typename V>
+   static void power(V zr, V zi, V zr2, V zi2, V &nr, V &ni) {
+      V zri = zr * zi;
+      nr = zr2 - zi2;
+      ni = zri + zri;
+   }
+
+   // 2 z dz.
+   template <typename V>
+   static void derivative(V zr, V zi, V, V, V dr, V di, V &nr, V &ni) {
+      V zdr = zr * dr - zi * di;
+      V zdi = zr * di + zi * dr;
+      nr = zdr + zdr;
+      ni = zdi + zdi;
+   }
+};
+
+template <>
+struct Formula_step<Formula::z3> {
+   template <typename V>
+   static void power(V zr, V zi, V zr2, V zi2, V &nr, V &ni) {
+      const V three = V::broadcast(3.0);
+      nr = zr * (zr2 - three * zi2);
+      ni = zi * (three * zr2 - zi2);
+   }
+
+   // 3 z^2 dz.
+   template <typename V>
+   static void derivative(V zr, V zi, V zr2, V zi2, V dr, V di, V &nr,
+                          V &ni) {
+      const V three = V::broadcast(3.0);
+      V sr = zr2 - zi2;
+      V si = zr * zi;
+      si = si + si;
+      nr = three * (sr * dr - si * di);
+      ni = three * (sr * di + si * dr);
+   }
+};
+
+template <>
+struct Formula_step<Formula::z4> {
+   template <typename V>
+   static void power(V zr, V zi, V zr2, V zi2, V &nr, V &ni) {
+      V sr = zr2 - zi2;
+      V si = zr * zi;
+      si = si + si;
+      V sri = sr * si;
+      nr = sr * sr - si * si;
+      ni = sri + sri;
+   }
+
+   // 4 z^3 dz.
+   template <typename V>
+   static void derivative(V zr, V zi, V zr2, V zi2, V dr, V di, V &nr,
+                          V &ni) {
+      const V three = V::broadcast(3.0);
+      const V four = V::broadcast(4.0);
+      V pr = zr * (zr2 - three * zi2);
+      V pi = zi * (three * zr2 - zi2);
+      nr = four * (pr * dr - pi * di);
+      ni = four * (pr * di + pi * dr);
+   }
+};
+
+template <>
+struct Formula_step<Formula::burning_ship> {
+   template <typename V>
+   static void power(V zr, V zi, V zr2, V zi2, V &nr, V &ni) {
+      V zri = absolute(zr * zi);
+      nr = zr2 - zi2;
+      ni = zri + zri;
+   }
+
+   // 2 w dw for w = |Re z| + |Im z| i.
+   template <typename V>
+   static void derivative(V zr, V zi, V, V, V dr, V di, V &nr, V &ni) {
+      const V zero = V::broadcast(0.0);
+      V wdr = V::select(V::less(zr, zero), zero - dr, dr);
+      V wdi = V::select(V::less(zi, zero), zero - di, di);
+      V wr = absolute(zr);
+      V wi = absolute(zi);
+      V pr = wr * wdr - wi * wdi;
+      V pi = wr * wdi + wi * wdr;
+      nr = pr + pr;
+      ni = pi + pi;
+   }
+};
+
+template <>
+struct Formula_step<Formula::tricorn> {
+   template <typename V>
+   static void power(V zr, V zi, V zr2, V zi2, V &nr, V &ni) {
+      V zri = zr * zi;
+      nr = zr2 - zi2;
+      ni = V::broadcast(0.0) - (zri + zri);
+   }
+
+   // 2 conj(z dz).
+   template <typename V>
+   static void derivative(V zr, V zi, V, V, V dr, V di, V &nr, V &ni) {
+      V zdr = zr * dr - zi * di;
+      V zdi = zr * di + zi * dr;
+      nr = zdr + zdr;
+      ni = V::broadcast(0.0) - (zdi + zdi);
+   }
+};
+
+// Iterates formula. With with_distance, also carries the derivative dz of
+// each orbit with respect to c, or to the starting point for Julia sets,
+// and writes the distance estimate described at escape_time(); for z^2,
+// four more multiplies and four adds an iteration.
+template <typename V, Formula formula, bool with_distance>
+void escape_time_block(const Fractal &fractal, const typename V::Scalar *re,
+                       const typename V::Scalar *im, int *iterations,
+                       double *norms, double *distances) {
+   using Scalar = typename V::Scalar;
+   V zr, zi, cr, ci;
+   if (fractal.type == Fractal_type::mandelbrot) {
+      zr = V::broadcast(0.0);
+      zi = V::broadcast(0.0);
+      cr = V::load(re);
+      ci = V::load(im);
+   } else {
+      zr = V::load(re);
+      zi = V::load(im);
+      cr = V::broadcast(fractal.c.real());
+      ci = V::broadcast(fractal.c.imag());
+   }
+   const V four = V::broadcast(4.0);
+   const V one = V::broadcast(1.0);
+   bool mandelbrot = fractal.type == Fractal_type::mandelbrot;
+   // dz/dc starts at 0 and gains 1 each iteration; dz/dz0 starts at 1.
+   V dr = V::broadcast(mandelbrot ? 0.0 : 1.0);
+   V di = V::broadcast(0.0);
+   const V dc = V::broadcast(mandelbrot ? 1.0 : 0.0);
+
+   V count = V::broadcast(0.0);
+   V zr2 = zr * zr;
+   V zi2 = zi * zi;
+   typename V::Mask active = V::less(zr2 + zi2, four);
+   typename V::Mask inside = V::less(four, four); // No lanes.
+   if (formula == Formula::z2 && mandelbrot) {
+      inside = in_cardioid_or_bulb(cr, ci);
+      active = V::but_not(active, inside);
+   }
+
+   // Brent's cycle detection: z is saved after 1, 2, 4, 8... iterations and
+   // compared with every later value. An orbit that returns exactly to a
+   // saved value is periodic and can never escape, so stopping it changes
+   // nothing in the result.
+   V saved_r = zr;
+   V saved_i = zi;
+   int next_save = 1;
+   for (int n = 0; n < fractal.max_iter && V::any(active); ++n) {
+      if (with_distance) {
+         // dz -> f'(z) dz + dc, from z before this iteration.
+         V fr, fi;
+         Formula_step<formula>::derivative(zr, zi, zr2, zi2, dr, di, fr, fi);
+         dr = V::select(active, fr + dc, dr);
+         di = V::select(active, fi, di);
+      }
+      V nr, ni;
+      Formula_step<formula>::power(zr, zi, zr2, zi2, nr, ni);
+      zr = V::select(active, nr + cr, zr);
+      zi = V::select(active, ni + ci, zi);
+      count = V::select(active, count + one, count);
+      zr2 = zr * zr;
+      zi2 = zi * zi;
+      active = V::both(active, V::less(zr2 + zi2, four));
+
+      typename V::Mask cycled = V::both(
+          active, V::both(V::equal(zr, saved_r), V::equal(zi, saved_i)));
+      inside = V::either(inside, cycled);
+      active = V::but_not(active, cycled);
+      if (n + 1 == next_save) {
+         saved_r = zr;
+         saved_i = zi;
+         next_save *= 2;
+      }
+   }
+   count = V::select(inside, V::broadcast(fractal.max_iter), count);
+
+   Scalar counts[V::lanes], final_norms[V::lanes];
+   V::store(counts, count);
+   V::store(final_norms, zr2 + zi2);
+   for (size_t k = 0; k < V::lanes; ++k) {
+      iterations[k] = static_cast<int>(static_cast<double>(counts[k]));
+      norms[k] = static_cast<double>(final_norms[k]);
+   }
+   if (!with_distance)
+      return;
+   Scalar derivative_r[V::lanes], derivative_i[V::lanes];
+   V::store(derivative_r, dr);
+   V::store(derivative_i, di);
+   for (size_t k = 0; k < V::lanes; ++k) {
+      double r = static_cast<double>(derivative_r[k]);
+      double i = static_cast<double>(derivative_i[k]);
+      distances[k] = exterior_distance(norms[k], r * r + i * i);
+   }
+}
+
+// Pads a partial block with copies of its last point, which cost no more
+// than the points already in the block.
+template <size_t lanes, typename Scalar>
+void fill_tail(const Scalar *source, size_t remaining, Scalar *tail) {
+   for (size_t t = 0; t < lanes; ++t)
+      tail[t] = source[t < remaining ? t : remaining - 1];
+}
+
+template <typename V, Formula formula, bool with_distance>
+void escape_time_blocks(const Fractal &fractal, const typename V::Scalar *re,
+                        const typename V::Scalar *im, size_t count,
+                        int *iterations, double *norms, double *distances) {
+   using Scalar = typename V::Scalar;
+   size_t k = 0;
+   for (; k + V::lanes <= count; k += V::lanes)
+      escape_time_block<V, formula, with_distance>(
+          fractal, re + k, im + k, iterations + k, norms + k,
+          with_distance ? distances + k : nullptr);
+   if (k == count)
+      return;
+
+   Scalar tail_re[V::lanes], tail_im[V::lanes];
+   double tail_norms[V::lanes], tail_distances[V::lanes];
+   int tail_iterations[V::lanes];
+   size_t remaining = count - k;
+   fill_tail<V::lanes>(re + k, remaining, tail_re);
+   fill_tail<V::lanes>(im + k, remaining, tail_im);
+   escape_time_block<V, formula, with_distance>(fractal, tail_re, tail_im,
+                                                tail_iterations, tail_norms,
+                                                tail_distances);
+   for (size_t t = 0; t < remaining; ++t) {
+      iterations[k + t] = tail_iterations[t];
+      norms[k + t] = tail_norms[t];
+      if (with_distance)
+         distances[k + t] = tail_distances[t];
+   }
+}
+
+template <typename Float_type>
+using Escape_time_function = void (*)(const Fractal &, const Float_type *,
+                                      const Float_type *, size_t, int *,
+                                      double *, double *);
+
+template <typename V, Formula formula>
+Escape_time_function<typename V::Scalar>
+escape_time_variant(bool with_distance) {
+   return with_distance ? &escape_time_blocks<V, formula, true>
+                        : &escape_time_blocks<V, formula, false>;
+}
+
+// The loop for formula, with or without distances.
+template <typename V>
+Escape_time_function<typename V::Scalar>
+escape_time_variant(Formula formula, bool with_distance) {
+   switch (formula) {
+   case Formula::z2:
+      return escape_time_variant<V, Formula::z2>(with_distance);
+   case Formula::z3:
+      return escape_time_variant<V, Formula::z3>(with_distance);
+   case Formula::z4:
+      return escape_time_variant<V, Formula::z4>(with_distance);
+   case Formula::burning_ship:
+      return escape_time_variant<V, Formula::burning_ship>(with_distance);
+   case Formula::tricorn:
+      return escape_time_variant<V, Formula::tricorn>(with_distance);
+   }
+   return nullptr;
+}
+
+// A pixel whose |z| falls below this fraction of the reference orbit's |Z|
+// (Pauldelbrot's criterion, squared) has lost the precision that made the
+// perturbation valid.
+static constexpr double glitch_tolerance = 1e-6;
+
+template <typename V>
+void perturbed_block(const Perturbation &p, const double *dc_re,
+                     const double *dc_im, int *iterations, double *norms,
+                     uint8_t *glitched) {
+   V dcr = V::load(dc_re);
+   V dci = V::load(dc_im);
+   V dc2r = dcr * dcr - dci * dci;
+   V dc2i = dcr * dci + dcr * dci;
+   V dc3r = dc2r * dcr - dc2i * dci;
+   V dc3i = dc2r * dci + dc2i * dcr;
+   V ar = V::broadcast(p.a.real()), ai = V::broadcast(p.a.imag());
+   V br = V::broadcast(p.b.real()), bi = V::broadcast(p.b.imag());
+   V cr = V::broadcast(p.c.real()), ci = V::broadcast(p.c.imag());
+   V dr = ar * dcr - ai * dci + br * dc2r - bi * dc2i + cr * dc3r - ci * dc3i;
+   V di = ar * dci + ai * dcr + br * dc2i + bi * dc2r + cr * dc3i + ci * dc3r;
+
+   const V four = V::broadcast(4.0);
+   const V tolerance = V::broadcast(glitch_tolerance);
+   V count = V::broadcast(p.start);
+   V final_norm = V::broadcast(0.0);
+   typename V::Mask active = V::equal(four, four); // All lanes.
+   typename V::Mask glitch = V::less(four, four);  // No lanes.
+   for (int n = p.start;; ++n) {
+      if (static_cast<size_t>(n) >= p.length) {
+         glitch = V::either(glitch, active);
+         break;
+      }
+      V zr_ref = V::broadcast(p.orbit_re[n]);
+      V zi_ref = V::broadcast(p.orbit_im[n]);
+      V zr = zr_ref + dr;
+      V zi = zi_ref + di;
+      V norm = zr * zr + zi * zi;
+      count = V::select(active, V::broadcast(n), count);
+      final_norm = V::select(active, norm, final_norm);
+      if (n == p.max_iter)
+         break;
+
+      active = V::both(active, V::less(norm, four));
+      typename V::Mask lost = V::both(
+          active,
+          V::less(norm, tolerance * (zr_ref * zr_ref + zi_ref * zi_ref)));
+      glitch = V::either(glitch, lost);
+      active = V::but_not(active, lost);
+      if (!V::any(active))
+         break;
+
+      V zd_r = zr_ref * dr - zi_ref * di;
+      V zd_i = zr_ref * di + zi_ref * dr;
+      V dri = dr * di;
+      V next_r = zd_r + zd_r + (dr * dr - di * di) + dcr;
+      V next_i = zd_i + zd_i + (dri + dri) + dci;
+      dr = V::select(active, next_r, dr);
+      di = V::select(active, next_i, di);
+   }
+
+   double counts[V::lanes], flags[V::lanes];
+   V::store(counts, count);
+   V::store(norms, final_norm);
+   V::store(flags, V::select(glitch, V::broadcast(1.0), V::broadcast(0.0)));
+   for (size_t k = 0; k < V::lanes; ++k) {
+      iterations[k] = static_cast<int>(counts[k]);
+      glitched[k] = flags[k] != 0.0;
+   }
+}
+
+template <typename V>
+void perturbed_kernel(const Perturbation &perturbation, const double *dc_re,
+                      const double *dc_im, size_t count, int *iterations,
+                      double *norms, uint8_t *glitched) {
+   size_t k = 0;
+   for (; k + V::lanes <= count; k += V::lanes)
+      perturbed_block<V>(perturbation, dc_re + k, dc_im + k, iterations + k,
+                         norms + k, glitched + k);
+   if (k == count)
+      return;
+
+   double tail_re[V::lanes], tail_im[V::lanes], tail_norms[V::lanes];
+   int tail_iterations[V::lanes];
+   uint8_t tail_glitched[V::lanes];
+   size_t remaining = count - k;
+   fill_tail<V::lanes>(dc_re + k, remaining, tail_re);
+   fill_tail<V::lanes>(dc_im + k, remaining, tail_im);
+   perturbed_block<V>(perturbation, tail_re, tail_im, tail_iterations,
+                      tail_norms, tail_glitched);
+   for (size_t t = 0; t < remaining; ++t) {
+      iterations[k + t] = tail_iterations[t];
+      norms[k + t] = tail_norms[t];
+      glitched[k + t] = tail_glitched[t];
+   }
+}
+
+using Perturbed_function = void (*)(const Perturbation &, const double *,
+                                    const double *, size_t, int *, double *,
+                                    uint8_t *);
+
+// The kernels built for one ISA. Float vectors hold twice as many lanes as
+// double vectors, so single precision runs at close to twice the speed
+// where its precision is enough. The escape-time loops are indexed by
+// formula and then by whether distances are wanted.
+struct Kernel_table {
+   Escape_time_function<float> escape_time_float[formula_count][2];
+   Escape_time_function<double> escape_time_double[formula_count][2];
+   Perturbed_function perturbed;
+};
+
+template <typename Float_vector, typename Double_vector>
+Kernel_table make_kernel_table() {
+   Kernel_table table{};
+   for (int f = 0; f < formula_count; ++f) {
+      for (int d = 0; d < 2; ++d) {
+         auto formula = static_cast<Formula>(f);
+         table.escape_time_float[f][d] =
+             escape_time_variant<Float_vector>(formula, d != 0);
+         table.escape_time_double[f][d] =
+             escape_time_variant<Double_vector>(formula, d != 0);
+      }
+   }
+   table.perturbed = &perturbed_kernel<Double_vector>;
+   return table;
+}
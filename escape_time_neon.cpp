@@ -0,0 +1,75 @@
+#include "escape_time_kernel.h"
+
+#include <arm_neon.h>
+
+namespace {
+
+struct Neon_float {
+   using Scalar = float;
+   using Mask = uint32x4_t;
+   static constexpr size_t lanes = 4;
+
+   float32x4_t v;
+
+   static Neon_float load(const float *p) { return {vld1q_f32(p)}; }
+   static void store(float *p, Neon_float a) { vst1q_f32(p, a.v); }
+   static Neon_float broadcast(float x) { return {vdupq_n_f32(x)}; }
+   static Mask less(Neon_float a, Neon_float b) { return vcltq_f32(a.v, b.v); }
+   static Mask less_equal(Neon_float a, Neon_float b) {
+      return vcleq_f32(a.v, b.v);
+   }
+   static Mask equal(Neon_float a, Neon_float b) {
+      return vceqq_f32(a.v, b.v);
+   }
+   static Mask both(Mask m, Mask n) { return vandq_u32(m, n); }
+   static Mask either(Mask m, Mask n) { return vorrq_u32(m, n); }
+   static Mask but_not(Mask m, Mask n) { return vbicq_u32(m, n); }
+   static bool any(Mask m) { return vmaxvq_u32(m) != 0; }
+   static Neon_float select(Mask m, Neon_float a, Neon_float b) {
+      return {vbslq_f32(m, a.v, b.v)};
+   }
+
+   Neon_float operator+(Neon_float b) const { return {vaddq_f32(v, b.v)}; }
+   Neon_float operator-(Neon_float b) const { return {vsubq_f32(v, b.v)}; }
+   Neon_float operator*(Neon_float b) const { return {vmulq_f32(v, b.v)}; }
+};
+
+struct Neon_double {
+   using Scalar = double;
+   using Mask = uint64x2_t;
+   static constexpr size_t lanes = 2;
+
+   float64x2_t v;
+
+   static Neon_double load(const double *p) { return {vld1q_f64(p)}; }
+   static void store(double *p, Neon_double a) { vst1q_f64(p, a.v); }
+   static Neon_double broadcast(double x) { return {vdupq_n_f64(x)}; }
+   static Mask less(Neon_double a, Neon_double b) {
+      return vcltq_f64(a.v, b.v);
+   }
+   static Mask less_equal(Neon_double a, Neon_double b) {
+      return vcleq_f64(a.v, b.v);
+   }
+   static Mask equal(Neon_double a, Neon_double b) {
+      return vceqq_f64(a.v, b.v);
+   }
+   static Mask both(Mask m, Mask n) { return vandq_u64(m, n); }
+   static Mask either(Mask m, Mask n) { return vorrq_u64(m, n); }
+   static Mask but_not(Mask m, Mask n) { return vbicq_u64(m, n); }
+   static bool any(Mask m) {
+      return (vgetq_lane_u64(m, 0) | vgetq_lane_u64(m, 1)) != 0;
+   }
+   static Neon_double select(Mask m, Neon_double a, Neon_double b) {
+      return {vbslq_f64(m, a.v, b.v)};
+   }
+
+   Neon_double operator+(Neon_double b) const { return {vaddq_f64(v, b.v)}; }
+   Neon_double operator-(Neon_double b) const { return {vsubq_f64(v, b.v)}; }
+   Neon_double operator*(Neon_double b) const { return {vmulq_f64(v, b.v)}; }
+};
+
+} // namespace
+
+Kernel_table neon_kernels() {
+   return make_kernel_table<Neon_float, Neon_double>();
+}
@@ -0,0 +1,228 @@
+#include "frame.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+template <typename Float_type>
+void escape_tile(const Fractal &fractal, const Render_settings &settings,
+                 const Tile &tile, const double *x, const double *y,
+                 int *iterations, double *norms, double *distances) {
+   const Viewport &viewport = settings.viewport;
+   std::vector<Float_type> re(tile.width);
+   std::vector<Float_type> im(tile.height);
+   for (size_t j = 0; j < tile.width; ++j)
+      re[j] = plane_coordinate<Float_type>(viewport.centre_re,
+                                           offset_re(viewport, x[j]));
+   for (size_t i = 0; i < tile.height; ++i)
+      im[i] = plane_coordinate<Float_type>(viewport.centre_im,
+                                           offset_im(viewport, y[i]));
+   if (distances == nullptr) {
+      render_escape_tile(fractal, settings.method, tile.width, tile.height,
+                         re.data(), im.data(), iterations, norms, tile.width);
+      return;
+   }
+   // Subdivision would fill pixels without their distances, so every
+   // pixel is iterated.
+   std::vector<Float_type> row_im(tile.width);
+   for (size_t i = 0; i < tile.height; ++i) {
+      std::fill(row_im.begin(), row_im.end(), im[i]);
+      size_t offset = i * tile.width;
+      escape_time(fractal, re.data(), row_im.data(), tile.width,
+                  iterations + offset, norms + offset, distances + offset);
+   }
+}
+
+// Iterates the pixels of one tile that lie on the grid of the given step but
+// not on that of previous_step, which have been done already.
+template <typename Float_type>
+void escape_pass_tile(const Fractal &fractal, const Render_settings &settings,
+                      const Tile &tile, size_t step, size_t previous_step,
+                      Escape_buffer &escape) {
+   const Viewport &viewport = settings.viewport;
+   std::vector<Float_type> re, im;
+   std::vector<size_t> columns;
+   std::vector<int> iterations;
+   std::vector<double> norms;
+   for (size_t y = tile.y; y < tile.y + tile.height; ++y) {
+      if (y % step != 0)
+         continue;
+      bool done_row = previous_step != 0 && y % previous_step == 0;
+      columns.clear();
+      re.clear();
+      for (size_t x = tile.x; x < tile.x + tile.width; ++x) {
+         if (x % step != 0 || (done_row && x % previous_step == 0))
+            continue;
+         columns.push_back(x);
+         re.push_back(plane_coordinate<Float_type>(
+             viewport.centre_re,
+             offset_re(viewport, static_cast<double>(x) /
+                                     static_cast<double>(escape.width))));
+      }
+      size_t count = columns.size();
+      if (count == 0)
+         continue;
+      im.assign(count, plane_coordinate<Float_type>(
+                           viewport.centre_im,
+                           offset_im(viewport,
+                                     static_cast<double>(y) /
+                                         static_cast<double>(escape.height))));
+      iterations.resize(count);
+      norms.resize(count);
+      escape_time(fractal, re.data(), im.data(), count, iterations.data(),
+                  norms.data());
+      for (size_t k = 0; k < count; ++k)
+         store_escape(escape, y * escape.width + columns[k], &iterations[k],
+                      &norms[k], 1);
+   }
+}
+
+} // namespace
+
+void fractal_escape_tile(const Fractal &fractal,
+                         const Render_settings &settings, const Tile &tile,
+                         const double *x, const double *y, int *iterations,
+                         double *norms, double *distances) {
+   switch (settings.precision) {
+   case Precision::float32:
+      escape_tile<float>(fractal, settings, tile, x, y, iterations, norms,
+                         distances);
+      break;
+   case Precision::automatic:
+   case Precision::float64:
+      escape_tile<double>(fractal, settings, tile, x, y, iterations, norms,
+                          distances);
+      break;
+   case Precision::double_double:
+      escape_tile<Double_double>(fractal, settings, tile, x, y, iterations,
+                                 norms, distances);
+      break;
+   }
+}
+
+void render_escape_pass(Thread_pool &pool, const Fractal &fractal,
+                        const Render_settings &settings, size_t step,
+                        size_t previous_step, Escape_buffer &escape) {
+   std::vector<Tile> tiles =
+       make_tiles(escape.width, escape.height, default_tile_size);
+   pool.run(tiles.size(), [&](size_t index, size_t) {
+      const Tile &tile = tiles[index];
+      Trace_scope scope("pass tile", tile.x, tile.y);
+      switch (settings.precision) {
+      case Precision::float32:
+         escape_pass_tile<float>(fractal, settings, tile, step, previous_step,
+                                 escape);
+         break;
+      case Precision::automatic:
+      case Precision::float64:
+         escape_pass_tile<double>(fractal, settings, tile, step,
+                                  previous_step, escape);
+         break;
+      case Precision::double_double:
+         escape_pass_tile<Double_double>(fractal, settings, tile, step,
+                                         previous_step, escape);
+         break;
+      }
+   });
+}
+
+void fractal_tile(const Fractal &fractal, const Render_settings &settings,
+                  const Tile &tile, const double *x, const double *y,
+                  uint32_t *out, size_t stride, Escape_summary *summary,
+                  int *iterations) {
+   const Palette &palette = settings.palette;
+   bool shaded = palette.boundary > 0;
+   std::vector<int> own_iterations(iterations != nullptr
+                                       ? 0
+                                       : tile.width * tile.height);
+   if (iterations == nullptr)
+      iterations = own_iterations.data();
+   std::vector<double> norms(tile.width * tile.height);
+   std::vector<double> distances(shaded ? tile.width * tile.height : 0);
+   fractal_escape_tile(fractal, settings, tile, x, y, iterations,
+                       norms.data(), shaded ? distances.data() : nullptr);
+   int highest = 0;
+   uint64_t total = 0;
+   for (size_t i = 0; i < tile.height; ++i) {
+      uint32_t *row = out + i * stride;
+      for (size_t j = 0; j < tile.width; ++j) {
+         size_t k = i * tile.width + j;
+         total += static_cast<uint64_t>(iterations[k]);
+         if (norms[k] > 4.0)
+            highest = std::max(highest, iterations[k]);
+         row[j] = palette.colour(static_cast<uint32_t>(iterations[k]),
+                                 compact_norm(norms[k]));
+         if (shaded && norms[k] > 4.0)
+            row[j] = palette.shade(row[j], distances[k] / settings.pixel_size);
+      }
+   }
+   if (summary != nullptr)
+      summary->record(highest);
+   trace_iterations(total);
+}
+
+void render_escape_region(Thread_pool &pool, const Fractal &fractal,
+                          const Render_settings &settings,
+                          Escape_buffer &escape, const Tile &region) {
+   std::vector<double> xs(region.width);
+   std::vector<double> ys(region.height);
+   for (size_t j = 0; j < region.width; ++j)
+      xs[j] = static_cast<double>(region.x + j) /
+              static_cast<double>(escape.width);
+   for (size_t i = 0; i < region.height; ++i)
+      ys[i] = static_cast<double>(region.y + i) /
+              static_cast<double>(escape.height);
+   std::vector<Tile> tiles =
+       make_tiles(region.width, region.height, default_tile_size);
+   pool.run(tiles.size(), [&](size_t index, size_t) {
+      const Tile &tile = tiles[index];
+      Trace_scope scope("escape tile", region.x + tile.x, region.y + tile.y);
+      std::vector<int> iterations(tile.width * tile.height);
+      std::vector<double> norms(tile.width * tile.height);
+      fractal_escape_tile(fractal, settings, tile, xs.data() + tile.x,
+                          ys.data() + tile.y, iterations.data(),
+                          norms.data());
+      uint64_t total = 0;
+      for (int count : iterations)
+         total += static_cast<uint64_t>(count);
+      trace_iterations(total);
+      for (size_t i = 0; i < tile.height; ++i)
+         store_escape(escape,
+                      (region.y + tile.y + i) * escape.width + region.x +
+                          tile.x,
+                      iterations.data() + i * tile.width,
+                      norms.data() + i * tile.width, tile.width);
+   });
+}
+
+void render_escape(Thread_pool &pool, const Fractal &fractal,
+                   const Render_settings &settings, Escape_buffer &escape) {
+   render_escape_region(pool, fractal, settings, escape,
+                        {0, 0, escape.width, escape.height});
+}
+
+void mandelbrot(const Render_settings &settings, const Tile &tile,
+                const double *x, const double *y, uint32_t *out,
+                size_t stride) {
+   fractal_tile({Fractal_type::mandelbrot, 0.0, settings.max_iter}, settings,
+                tile, x, y, out, stride);
+}
+
+void julia(const Render_settings &settings, std::complex<double> c,
+           const Tile &tile, const double *x, const double *y, uint32_t *out,
+           size_t stride) {
+   fractal_tile({Fractal_type::julia, c, settings.max_iter}, settings, tile, x,
+                y, out, stride);
+}
+
+std::complex<double> julia_constant(double t) {
+   return 0.7885 * std::exp(t * std::complex<double>(0, 1));
+}
+
+void animate_julia(const Render_settings &settings, double t,
+                   const Tile &tile, const double *x, const double *y,
+                   uint32_t *out, size_t stride) {
+   julia(settings, julia_constant(t), tile, x, y, out, stride);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "escape_render.h"
+#include "escape_buffer.h"
+#include "escape_time.h"
+#include "iteration_budget.h"
+#include "palette.h"
+#include "render.h"
+#include "thread_pool.h"
+#include "viewport.h"
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+struct Render_settings {
+   Render_method method;
+   Viewport viewport;
+   int max_iter;
+   // Must be resolved to a concrete precision before rendering; automatic
+   // is treated as double.
+   Precision precision;
+   Palette palette = grey_palette();
+   // The distance between neighbouring pixels in the plane, for boundary
+   // shading.
+   double pixel_size = 0;
+};
+
+// Computes escape_time() results for the pixels of a tile, stored tile.width
+// apart from one row to the next, with distance estimates if distances is
+// given.
+void fractal_escape_tile(const Fractal &fractal,
+                         const Render_settings &settings, const Tile &tile,
+                         const double *x, const double *y, int *iterations,
+                         double *norms, double *distances = nullptr);
+
+// Fills escape, which gives the image size, with the escape times of
+// fractal over the viewport.
+void render_escape(Thread_pool &pool, const Fractal &fractal,
+                   const Render_settings &settings, Escape_buffer &escape);
+
+// As render_escape(), but only for the pixels of region.
+void render_escape_region(Thread_pool &pool, const Fractal &fractal,
+                          const Render_settings &settings,
+                          Escape_buffer &escape, const Tile &region);
+
+// One pass of a progressive render_escape(): iterates the pixels whose
+// coordinates are both multiples of step, skipping those that are both
+// multiples of previous_step. Passes with steps 8, 4, 2 and 1, each given the
+// step before it (0 for the first), fill the buffer exactly once. The
+// method in settings is ignored; every pixel of a pass is iterated.
+void render_escape_pass(Thread_pool &pool, const Fractal &fractal,
+                        const Render_settings &settings, size_t step,
+                        size_t previous_step, Escape_buffer &escape);
+
+// Tile functions for generate_tiles(), rendering the Mandelbrot set, the
+// Julia set for c, and the Julia set at time t of the animation. Each tile is
+// iterated and coloured with the settings' palette in one pass, and its
+// highest escape count recorded in summary if given. These are the renders
+// that apply the palette's boundary shading, which needs pixel_size. If
+// iterations is given, it receives the escape counts, tile.width apart from
+// one row to the next.
+void fractal_tile(const Fractal &fractal, const Render_settings &settings,
+                  const Tile &tile, const double *x, const double *y,
+                  uint32_t *out, size_t stride,
+                  Escape_summary *summary = nullptr,
+                  int *iterations = nullptr);
+
+void mandelbrot(const Render_settings &settings, const Tile &tile,
+                const double *x, const double *y, uint32_t *out,
+                size_t stride);
+
+void julia(const Render_settings &settings, std::complex<double> c,
+           const Tile &tile, const double *x, const double *y, uint32_t *out,
+           size_t stride);
+
+// The Julia constant at time t of the animation.
+std::complex<double> julia_constant(double t);
+
+void animate_julia(const Render_settings &settings, double t,
+                   const Tile &tile, const double *x, const double *y,
+                   uint32_t *out, size_t stride);
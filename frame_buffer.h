@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+constexpr size_t cache_line_size = 64;
+
+// RGBA8888 pixels in memory owned by the renderer, allocated once and reused
+// for every frame. The buffer starts on a cache line and each row is padded
+// to a whole number of cache lines, so tiles whose left edges fall on
+// multiples of 16 pixels (all of them, with the usual tile sizes) never share
+// a line with a tile on another thread.
+class Frame_buffer {
+ public:
+   Frame_buffer(size_t width, size_t height)
+       : width_(width), height_(height),
+         pitch_((width * sizeof(uint32_t) + cache_line_size - 1) /
+                cache_line_size * cache_line_size),
+         storage_(new uint8_t[pitch_ * height + cache_line_size - 1]) {
+      uintptr_t address = reinterpret_cast<uintptr_t>(storage_.get());
+      data_ = storage_.get() +
+              (cache_line_size - address % cache_line_size) % cache_line_size;
+   }
+
+   size_t width() const { return width_; }
+   size_t height() const { return height_; }
+   // Bytes from the start of one row to the next.
+   size_t pitch() const { return pitch_; }
+
+   uint8_t *data() { return data_; }
+   const uint8_t *data() const { return data_; }
+   const uint32_t *pixels() const {
+      return reinterpret_cast<const uint32_t *>(data_);
+   }
+
+ private:
+   size_t width_;
+   size_t height_;
+   size_t pitch_;
+   std::unique_ptr<uint8_t[]> storage_;
+   uint8_t *data_;
+};
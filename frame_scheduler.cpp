@@ -0,0 +1,28 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Limits on how far one frame moves the scale.
+constexpr double largest_drop = 0.8;
+constexpr double largest_rise = 1.05;
+
+} // namespace
+
+size_t Frame_scheduler::scaled(size_t size) const {
+   auto result =
+       static_cast<size_t>(std::lround(static_cast<double>(size) * scale_));
+   return std::max<size_t>(1, std::min(result, size));
+}
+
+void Frame_scheduler::record(const Frame_timing &timing) {
+   if (timing.seconds <= 0)
+      return;
+   // The work, and so the time, goes with the number of pixels: the square
+   // of the scale.
+   double ratio = std::sqrt(target_ / timing.seconds);
+   ratio = std::max(largest_drop, std::min(ratio, largest_rise));
+   scale_ = std::max(minimum_, std::min(timing.scale * ratio, 1.0));
+}
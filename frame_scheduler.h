@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// The time from the first tile of a frame starting to the last one
+// finishing, recorded by the tiles themselves on whichever threads run
+// them. Unlike timing the frame from the main thread, this leaves out the
+// time it spent queued behind the frame before it.
+class Frame_clock {
+ public:
+   using Clock = std::chrono::steady_clock;
+
+   void tile_started() {
+      Clock::rep now = Clock::now().time_since_epoch().count();
+      Clock::rep seen = start_.load(std::memory_order_relaxed);
+      while (now < seen && !start_.compare_exchange_weak(
+                               seen, now, std::memory_order_relaxed)) {
+      }
+   }
+
+   void tile_finished() {
+      Clock::rep now = Clock::now().time_since_epoch().count();
+      Clock::rep seen = end_.load(std::memory_order_relaxed);
+      while (now > seen && !end_.compare_exchange_weak(
+                               seen, now, std::memory_order_relaxed)) {
+      }
+   }
+
+   // Only meaningful once the frame is complete.
+   double seconds() const {
+      Clock::rep start = start_.load(std::memory_order_relaxed);
+      Clock::rep end = end_.load(std::memory_order_relaxed);
+      if (end < start)
+         return 0;
+      return std::chrono::duration<double>(Clock::duration(end - start))
+          .count();
+   }
+
+ private:
+   std::atomic<Clock::rep> start_{std::numeric_limits<Clock::rep>::max()};
+   std::atomic<Clock::rep> end_{std::numeric_limits<Clock::rep>::min()};
+};
+
+// Numbers the frames a render loop starts, so that it can call off those
+// that quitting or a newer frame has made stale. Tiles check live() before
+// rendering, so a frame called off stops within the time of one tile on
+// each worker, and only tiles of the frames still wanted run.
+class Frame_generations {
+ public:
+   // The generation of a frame about to start. Called by the loop alone.
+   uint64_t start() { return next_++; }
+
+   bool live(uint64_t generation) const {
+      return generation >= first_live_.load(std::memory_order_relaxed);
+   }
+
+   // Calls off every frame started before generation.
+   void cancel_before(uint64_t generation) {
+      uint64_t first = first_live_.load(std::memory_order_relaxed);
+      first_live_.store(std::max(first, generation),
+                        std::memory_order_relaxed);
+   }
+
+   void cancel_all() { cancel_before(next_); }
+
+ private:
+   uint64_t next_ = 0;
+   std::atomic<uint64_t> first_live_{0};
+};
+
+struct Frame_timing {
+   // The size the frame was rendered at, before scaling to the window.
+   size_t width;
+   size_t height;
+   double scale;
+   double seconds;
+};
+
+// Holds frames near a target render time by scaling the resolution they
+// are rendered at, from one down to minimum_scale of the full size in each
+// direction. The scale falls quickly when frames run long and recovers
+// slowly, so that a single cheap frame does not bring back the stutter.
+class Frame_scheduler {
+ public:
+   Frame_scheduler(double target_seconds, double minimum_scale = 0.25)
+       : target_(target_seconds), minimum_(minimum_scale) {}
+
+   double scale() const { return scale_; }
+
+   // One dimension of the next frame, given its full size.
+   size_t scaled(size_t size) const;
+
+   // Adjusts the scale after a frame has been rendered.
+   void record(const Frame_timing &timing);
+
+ private:
+   double target_;
+   double minimum_;
+   double scale_ = 1;
+};
@@ -0,0 +1,320 @@
+#include "gpu_render.h"
+
+#include <stdexcept>
+
+#ifdef FRACTALS_HAVE_OPENCL
+
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// The escape-time loop of escape_time_kernel.h for one pixel, with the same
+// cardioid test and cycle detection, followed by the palette lookup of
+// submit_colouring(). Built once with real as float and, where the device
+// supports it, once as double.
+const char *kernel_source = R"(
+#ifdef FRACTALS_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+__kernel void render(__global uint *pixels, uint stride, uint width,
+                     uint height, __global const real *xs,
+                     __global const real *ys, int julia, real c_re,
+                     real c_im, int max_iter, __global const uint *colours,
+                     uint inside) {
+   uint j = get_global_id(0);
+   uint i = get_global_id(1);
+   if (j >= width || i >= height)
+      return;
+
+   real zr = 0, zi = 0, cr = c_re, ci = c_im;
+   if (julia) {
+      zr = xs[j];
+      zi = ys[i];
+   } else {
+      cr = xs[j];
+      ci = ys[i];
+   }
+   real zr2 = zr * zr;
+   real zi2 = zi * zi;
+   bool in_set = false;
+   if (!julia) {
+      real y2 = ci * ci;
+      real xq = cr - (real)0.25;
+      real q = xq * xq + y2;
+      real x1 = cr + 1;
+      in_set = q * (q + xq) <= (real)0.25 * y2 ||
+               x1 * x1 + y2 <= (real)0.0625;
+   }
+
+   int count = 0;
+   real saved_r = zr, saved_i = zi;
+   int next_save = 1;
+   while (!in_set && count < max_iter && zr2 + zi2 < 4) {
+      real zri = zr * zi;
+      zr = zr2 - zi2 + cr;
+      zi = zri + zri + ci;
+      ++count;
+      zr2 = zr * zr;
+      zi2 = zi * zi;
+      if (!(zr2 + zi2 < 4))
+         break;
+      in_set = zr == saved_r && zi == saved_i;
+      if (count == next_save) {
+         saved_r = zr;
+         saved_i = zi;
+         next_save *= 2;
+      }
+   }
+   pixels[i * stride + j] = zr2 + zi2 > 4 ? colours[count] : inside;
+}
+)";
+
+void check(cl_int status, const char *what) {
+   if (status != CL_SUCCESS)
+      throw std::runtime_error(std::string(what) +
+                               " failed with OpenCL error " +
+                               std::to_string(status));
+}
+
+// A device buffer holding a copy of some host data, which is uploaded again
+// only when it changes.
+struct Input {
+   cl_mem buffer = nullptr;
+   std::vector<uint8_t> contents;
+};
+
+void upload(cl_context context, cl_command_queue queue, Input &input,
+            const void *data, size_t bytes) {
+   const uint8_t *begin = static_cast<const uint8_t *>(data);
+   if (input.buffer != nullptr && input.contents.size() == bytes &&
+       std::equal(begin, begin + bytes, input.contents.begin()))
+      return;
+   if (input.buffer == nullptr || input.contents.size() != bytes) {
+      // Kernels already queued keep the old buffer alive until they finish.
+      if (input.buffer != nullptr)
+         clReleaseMemObject(input.buffer);
+      cl_int status = CL_SUCCESS;
+      input.buffer =
+          clCreateBuffer(context, CL_MEM_READ_ONLY, bytes, nullptr, &status);
+      check(status, "clCreateBuffer");
+   }
+   // Blocking, as earlier frames may still be reading the buffer: the write
+   // waits for them, and data need not outlive the call.
+   check(clEnqueueWriteBuffer(queue, input.buffer, CL_TRUE, 0, bytes, data, 0,
+                              nullptr, nullptr),
+         "clEnqueueWriteBuffer");
+   input.contents.assign(begin, begin + bytes);
+}
+
+template <typename T>
+void set_argument(cl_kernel kernel, cl_uint index, const T &value) {
+   check(clSetKernelArg(kernel, index, sizeof(T), &value), "clSetKernelArg");
+}
+
+} // namespace
+
+struct Gpu_renderer::Device {
+   cl_context context = nullptr;
+   cl_command_queue queue = nullptr;
+   // Built for float and for double; the second is null without fp64.
+   cl_program programs[2] = {nullptr, nullptr};
+   cl_kernel kernels[2] = {nullptr, nullptr};
+   std::string name;
+   cl_mem pixels = nullptr;
+   size_t pixels_size = 0;
+   Input xs, ys, colours;
+
+   ~Device() {
+      if (queue != nullptr)
+         clFinish(queue);
+      for (Input *input : {&xs, &ys, &colours})
+         if (input->buffer != nullptr)
+            clReleaseMemObject(input->buffer);
+      if (pixels != nullptr)
+         clReleaseMemObject(pixels);
+      for (size_t k = 0; k < 2; ++k) {
+         if (kernels[k] != nullptr)
+            clReleaseKernel(kernels[k]);
+         if (programs[k] != nullptr)
+            clReleaseProgram(programs[k]);
+      }
+      if (queue != nullptr)
+         clReleaseCommandQueue(queue);
+      if (context != nullptr)
+         clReleaseContext(context);
+   }
+
+   void build(cl_device_id device, size_t index, const char *options) {
+      cl_int status = CL_SUCCESS;
+      programs[index] = clCreateProgramWithSource(context, 1, &kernel_source,
+                                                  nullptr, &status);
+      check(status, "clCreateProgramWithSource");
+      if (clBuildProgram(programs[index], 1, &device, options, nullptr,
+                         nullptr) != CL_SUCCESS) {
+         size_t size = 0;
+         clGetProgramBuildInfo(programs[index], device, CL_PROGRAM_BUILD_LOG,
+                               0, nullptr, &size);
+         std::string log(size, '\0');
+         clGetProgramBuildInfo(programs[index], device, CL_PROGRAM_BUILD_LOG,
+                               size, &log[0], nullptr);
+         throw std::runtime_error("Building the OpenCL kernel failed:\n" +
+                                  log);
+      }
+      kernels[index] = clCreateKernel(programs[index], "render", &status);
+      check(status, "clCreateKernel");
+   }
+
+   template <typename Real>
+   std::future<void> submit(cl_kernel kernel, const Fractal &fractal,
+                            const Render_settings &settings, uint8_t *out,
+                            size_t width, size_t height, size_t pitch) {
+      const Viewport &viewport = settings.viewport;
+      std::vector<Real> re(width), im(height);
+      for (size_t j = 0; j < width; ++j)
+         re[j] = plane_coordinate<Real>(
+             viewport.centre_re,
+             offset_re(viewport, static_cast<double>(j) /
+                                     static_cast<double>(width)));
+      for (size_t i = 0; i < height; ++i)
+         im[i] = plane_coordinate<Real>(
+             viewport.centre_im,
+             offset_im(viewport, static_cast<double>(i) /
+                                     static_cast<double>(height)));
+      std::vector<uint32_t> table = settings.palette.unroll(
+          static_cast<uint32_t>(settings.max_iter), 0);
+      upload(context, queue, xs, re.data(), re.size() * sizeof(Real));
+      upload(context, queue, ys, im.data(), im.size() * sizeof(Real));
+      upload(context, queue, colours, table.data(),
+             table.size() * sizeof(uint32_t));
+
+      size_t size = pitch * height;
+      if (size != pixels_size) {
+         if (pixels != nullptr)
+            clReleaseMemObject(pixels);
+         cl_int status = CL_SUCCESS;
+         pixels = clCreateBuffer(context, CL_MEM_WRITE_ONLY, size, nullptr,
+                                 &status);
+         check(status, "clCreateBuffer");
+         pixels_size = size;
+      }
+
+      set_argument(kernel, 0, pixels);
+      set_argument(kernel, 1, static_cast<cl_uint>(pitch / sizeof(uint32_t)));
+      set_argument(kernel, 2, static_cast<cl_uint>(width));
+      set_argument(kernel, 3, static_cast<cl_uint>(height));
+      set_argument(kernel, 4, xs.buffer);
+      set_argument(kernel, 5, ys.buffer);
+      set_argument(kernel, 6,
+                   static_cast<cl_int>(fractal.type == Fractal_type::julia));
+      set_argument(kernel, 7, static_cast<Real>(fractal.c.real()));
+      set_argument(kernel, 8, static_cast<Real>(fractal.c.imag()));
+      set_argument(kernel, 9, static_cast<cl_int>(settings.max_iter));
+      set_argument(kernel, 10, colours.buffer);
+      set_argument(kernel, 11, static_cast<cl_uint>(settings.palette.inside));
+
+      size_t global[2] = {width, height};
+      check(clEnqueueNDRangeKernel(queue, kernel, 2, nullptr, global, nullptr,
+                                   0, nullptr, nullptr),
+            "clEnqueueNDRangeKernel");
+      cl_event done = nullptr;
+      check(clEnqueueReadBuffer(queue, pixels, CL_FALSE, 0, size, out, 0,
+                                nullptr, &done),
+            "clEnqueueReadBuffer");
+      clFlush(queue);
+      return std::async(std::launch::deferred, [done] {
+         cl_int status = clWaitForEvents(1, &done);
+         clReleaseEvent(done);
+         check(status, "clWaitForEvents");
+      });
+   }
+};
+
+Gpu_renderer::Gpu_renderer() : device_(new Device) {
+   cl_uint num_platforms = 0;
+   clGetPlatformIDs(0, nullptr, &num_platforms);
+   std::vector<cl_platform_id> platforms(num_platforms);
+   if (num_platforms > 0)
+      check(clGetPlatformIDs(num_platforms, platforms.data(), nullptr),
+            "clGetPlatformIDs");
+   cl_device_id device = nullptr;
+   for (cl_platform_id platform : platforms)
+      if (clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, nullptr) ==
+          CL_SUCCESS)
+         break;
+   if (device == nullptr)
+      throw std::runtime_error("No OpenCL GPU found");
+
+   size_t size = 0;
+   clGetDeviceInfo(device, CL_DEVICE_NAME, 0, nullptr, &size);
+   std::string name(size, '\0');
+   clGetDeviceInfo(device, CL_DEVICE_NAME, size, &name[0], nullptr);
+   device_->name = name.c_str();
+   clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, nullptr, &size);
+   std::string extensions(size, '\0');
+   clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, size, &extensions[0],
+                   nullptr);
+
+   cl_int status = CL_SUCCESS;
+   device_->context =
+       clCreateContext(nullptr, 1, &device, nullptr, nullptr, &status);
+   check(status, "clCreateContext");
+   device_->queue =
+       clCreateCommandQueue(device_->context, device, 0, &status);
+   check(status, "clCreateCommandQueue");
+   device_->build(device, 0, "-Dreal=float");
+   if (extensions.find("cl_khr_fp64") != std::string::npos)
+      device_->build(device, 1, "-Dreal=double -DFRACTALS_FP64");
+}
+
+Gpu_renderer::~Gpu_renderer() = default;
+
+std::string Gpu_renderer::device_name() const { return device_->name; }
+
+std::future<void> Gpu_renderer::submit(const Fractal &fractal,
+                                       const Render_settings &settings,
+                                       uint8_t *pixels, size_t width,
+                                       size_t height, size_t pitch) {
+   switch (settings.precision) {
+   case Precision::float32:
+      return device_->submit<float>(device_->kernels[0], fractal, settings,
+                                    pixels, width, height, pitch);
+   case Precision::automatic:
+   case Precision::float64:
+      if (device_->kernels[1] == nullptr)
+         throw std::runtime_error(device_->name +
+                                  " does not support double precision");
+      return device_->submit<double>(device_->kernels[1], fractal, settings,
+                                     pixels, width, height, pitch);
+   case Precision::double_double:
+      break;
+   }
+   throw std::runtime_error("The GPU cannot render in double-double");
+}
+
+#else
+
+struct Gpu_renderer::Device {};
+
+Gpu_renderer::Gpu_renderer() {
+   throw std::runtime_error("This build has no OpenCL support");
+}
+
+Gpu_renderer::~Gpu_renderer() = default;
+
+std::string Gpu_renderer::device_name() const { return std::string(); }
+
+std::future<void> Gpu_renderer::submit(const Fractal &, const Render_settings &,
+                                       uint8_t *, size_t, size_t, size_t) {
+   throw std::runtime_error("This build has no OpenCL support");
+}
+
+#endif
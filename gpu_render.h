@@ -0,0 +1,41 @@
+#pragma once
+
+#include "escape_time.h"
+#include "frame.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+
+// Iterates and colours whole images on an OpenCL device, for builds with
+// OpenCL (FRACTALS_HAVE_OPENCL). Pixel coordinates and the unrolled palette
+// are computed as on the CPU and uploaded only when they change, so an
+// animation that only moves the Julia constant sends nothing but the frame
+// back each time.
+class Gpu_renderer {
+ public:
+   // Uses the first GPU on any platform. Throws std::runtime_error if there
+   // is none, or the build has no OpenCL.
+   Gpu_renderer();
+   ~Gpu_renderer();
+
+   Gpu_renderer(const Gpu_renderer &) = delete;
+   Gpu_renderer &operator=(const Gpu_renderer &) = delete;
+
+   std::string device_name() const;
+
+   // Starts rendering fractal into an RGBA8888 image, which must stay valid
+   // until the returned future is ready. Frames are rendered in the order
+   // they are submitted. The settings' precision must be resolved, and be
+   // float or, if the device supports it, double; the method is ignored,
+   // since every pixel is iterated.
+   std::future<void> submit(const Fractal &fractal,
+                            const Render_settings &settings, uint8_t *pixels,
+                            size_t width, size_t height, size_t pitch);
+
+ private:
+   struct Device;
+   std::unique_ptr<Device> device_;
+};
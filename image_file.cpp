@@ -0,0 +1,194 @@
+#include "image_file.h"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef FRACTALS_HAVE_PNG
+#include <csetjmp>
+#include <png.h>
+#endif
+
+namespace {
+
+bool has_extension(const std::string &path, const std::string &extension) {
+   return path.size() >= extension.size() &&
+          path.compare(path.size() - extension.size(), extension.size(),
+                       extension) == 0;
+}
+
+// Unpacks rows into bytes in the order red, green, blue and, if keep_alpha,
+// alpha.
+std::vector<uint8_t> unpack(const uint32_t *pixels, size_t width,
+                            size_t height, size_t stride, bool keep_alpha) {
+   size_t channels = keep_alpha ? 4 : 3;
+   std::vector<uint8_t> bytes(width * height * channels);
+   uint8_t *out = bytes.data();
+   for (size_t i = 0; i < height; ++i) {
+      const uint32_t *row = pixels + i * stride;
+      for (size_t j = 0; j < width; ++j) {
+         *out++ = static_cast<uint8_t>(row[j] >> 24);
+         *out++ = static_cast<uint8_t>(row[j] >> 16);
+         *out++ = static_cast<uint8_t>(row[j] >> 8);
+         if (keep_alpha)
+            *out++ = static_cast<uint8_t>(row[j]);
+      }
+   }
+   return bytes;
+}
+
+void write_ppm(const std::string &path, const uint32_t *pixels, size_t width,
+               size_t height, size_t stride) {
+   std::vector<uint8_t> bytes = unpack(pixels, width, height, stride, false);
+   std::ofstream file(path, std::ios::binary);
+   file << "P6\n" << width << ' ' << height << "\n255\n";
+   file.write(reinterpret_cast<const char *>(bytes.data()),
+              static_cast<std::streamsize>(bytes.size()));
+   if (!file)
+      throw std::runtime_error("Failed to write " + path);
+}
+
+#ifdef FRACTALS_HAVE_PNG
+void write_png(const std::string &path, const uint32_t *pixels, size_t width,
+               size_t height, size_t stride) {
+   std::vector<uint8_t> bytes = unpack(pixels, width, height, stride, true);
+   png_image image{};
+   image.version = PNG_IMAGE_VERSION;
+   image.width = static_cast<png_uint_32>(width);
+   image.height = static_cast<png_uint_32>(height);
+   image.format = PNG_FORMAT_RGBA;
+   if (!png_image_write_to_file(&image, path.c_str(), 0, bytes.data(), 0,
+                                nullptr))
+      throw std::runtime_error("Failed to write " + path + ": " +
+                               image.message);
+}
+#endif
+
+} // namespace
+
+void write_image(const std::string &path, const uint32_t *pixels,
+                 size_t width, size_t height, size_t stride) {
+   if (has_extension(path, ".ppm")) {
+      write_ppm(path, pixels, width, height, stride);
+      return;
+   }
+   if (has_extension(path, ".png")) {
+#ifdef FRACTALS_HAVE_PNG
+      write_png(path, pixels, width, height, stride);
+      return;
+#else
+      throw std::runtime_error("Built without libpng, cannot write " + path);
+#endif
+   }
+   throw std::runtime_error("Unknown image format: " + path);
+}
+
+struct Image_stream::State {
+   State(const std::string &p, size_t w, size_t h)
+       : path(p), width(w), height(h), png(has_extension(p, ".png")) {}
+   // Also runs if the Image_stream constructor throws part way.
+   ~State() {
+#ifdef FRACTALS_HAVE_PNG
+      if (writer != nullptr)
+         png_destroy_write_struct(&writer, &info);
+      if (file != nullptr)
+         std::fclose(file);
+#endif
+   }
+
+   std::string path;
+   size_t width;
+   size_t height;
+   size_t written = 0;
+   bool png;
+   std::ofstream ppm;
+#ifdef FRACTALS_HAVE_PNG
+   FILE *file = nullptr;
+   png_structp writer = nullptr;
+   png_infop info = nullptr;
+#endif
+};
+
+Image_stream::Image_stream(const std::string &path, size_t width,
+                           size_t height)
+    : state_(new State(path, width, height)) {
+   State &state = *state_;
+   if (!state.png) {
+      if (!has_extension(path, ".ppm"))
+         throw std::runtime_error("Unknown image format: " + path);
+      state.ppm.open(path, std::ios::binary);
+      state.ppm << "P6\n" << width << ' ' << height << "\n255\n";
+      if (!state.ppm)
+         throw std::runtime_error("Failed to write " + path);
+      return;
+   }
+#ifdef FRACTALS_HAVE_PNG
+   state.file = std::fopen(path.c_str(), "wb");
+   if (state.file != nullptr)
+      state.writer = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr,
+                                             nullptr, nullptr);
+   if (state.writer != nullptr)
+      state.info = png_create_info_struct(state.writer);
+   if (state.info == nullptr)
+      throw std::runtime_error("Failed to write " + path);
+   // libpng reports errors by jumping back here.
+   if (setjmp(png_jmpbuf(state.writer)))
+      throw std::runtime_error("Failed to write " + path);
+   png_init_io(state.writer, state.file);
+   png_set_IHDR(state.writer, state.info, static_cast<png_uint_32>(width),
+                static_cast<png_uint_32>(height), 8, PNG_COLOR_TYPE_RGBA,
+                PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                PNG_FILTER_TYPE_DEFAULT);
+   png_write_info(state.writer, state.info);
+#else
+   throw std::runtime_error("Built without libpng, cannot write " + path);
+#endif
+}
+
+Image_stream::~Image_stream() = default;
+
+void Image_stream::write_rows(const uint32_t *pixels, size_t rows,
+                              size_t stride) {
+   State &state = *state_;
+   if (state.written + rows > state.height)
+      throw std::runtime_error("Too many rows for " + state.path);
+   std::vector<uint8_t> bytes =
+       unpack(pixels, state.width, rows, stride, state.png);
+   state.written += rows;
+   if (!state.png) {
+      state.ppm.write(reinterpret_cast<const char *>(bytes.data()),
+                      static_cast<std::streamsize>(bytes.size()));
+      if (!state.ppm)
+         throw std::runtime_error("Failed to write " + state.path);
+      return;
+   }
+#ifdef FRACTALS_HAVE_PNG
+   if (setjmp(png_jmpbuf(state.writer)))
+      throw std::runtime_error("Failed to write " + state.path);
+   for (size_t i = 0; i < rows; ++i)
+      png_write_row(state.writer, bytes.data() + i * state.width * 4);
+#endif
+}
+
+void Image_stream::finish() {
+   State &state = *state_;
+   if (state.written != state.height)
+      throw std::runtime_error("Missing rows in " + state.path);
+   if (!state.png) {
+      state.ppm.close();
+      if (!state.ppm)
+         throw std::runtime_error("Failed to write " + state.path);
+      return;
+   }
+#ifdef FRACTALS_HAVE_PNG
+   if (setjmp(png_jmpbuf(state.writer)))
+      throw std::runtime_error("Failed to write " + state.path);
+   png_write_end(state.writer, state.info);
+   png_destroy_write_struct(&state.writer, &state.info);
+   FILE *file = state.file;
+   state.file = nullptr;
+   if (std::fclose(file) != 0)
+      throw std::runtime_error("Failed to write " + state.path);
+#endif
+}
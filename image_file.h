@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Writes an image of pixels packed by pack_rgba8888(), stride pixels apart
+// from one row to the next. The format follows the extension of path: ".ppm"
+// for binary PPM, which drops alpha, or ".png" when built with libpng.
+// Throws std::runtime_error for other extensions or if writing fails.
+void write_image(const std::string &path, const uint32_t *pixels,
+                 size_t width, size_t height, size_t stride);
+
+// Writes an image in the formats write_image() supports a band of rows at a
+// time, top first, so that the whole image never has to be in memory.
+// Throws std::runtime_error as write_image() does.
+class Image_stream {
+ public:
+   Image_stream(const std::string &path, size_t width, size_t height);
+   ~Image_stream();
+
+   Image_stream(const Image_stream &) = delete;
+   Image_stream &operator=(const Image_stream &) = delete;
+
+   // Appends rows rows of pixels, stride pixels apart.
+   void write_rows(const uint32_t *pixels, size_t rows, size_t stride);
+
+   // Completes the file once every row has been written.
+   void finish();
+
+ private:
+   struct State;
+   std::unique_ptr<State> state_;
+};
@@ -0,0 +1,29 @@
+#include "iteration_budget.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Iterations allowed at the default view, and added for each halving of
+// the view's extent from there.
+constexpr double base_iterations = 200;
+constexpr double iterations_per_halving = 200;
+
+} // namespace
+
+int highest_escape(const Escape_buffer &escape) {
+   uint32_t highest = 0;
+   for (size_t k = 0; k < escape.iterations.size(); ++k)
+      if (escape.norms[k] > 4.0f)
+         highest = std::max(highest, escape.iterations[k]);
+   return static_cast<int>(highest);
+}
+
+int depth_iterations(const Viewport &viewport) {
+   double extent = std::min(viewport.half_width, viewport.half_height);
+   double halvings =
+       std::max(0.0, std::log2(default_viewport().half_width / extent));
+   double limit = base_iterations + iterations_per_halving * halvings;
+   return limit < 1e9 ? static_cast<int>(limit) : 1000000000;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "escape_buffer.h"
+#include "viewport.h"
+
+#include <algorithm>
+#include <atomic>
+
+// The highest escape count among the pixels of a frame, gathered from tiles
+// as they finish on any thread.
+class Escape_summary {
+ public:
+   void record(int iterations) {
+      int seen = highest_.load(std::memory_order_relaxed);
+      while (iterations > seen &&
+             !highest_.compare_exchange_weak(seen, iterations,
+                                             std::memory_order_relaxed)) {
+      }
+   }
+
+   int highest() const { return highest_.load(std::memory_order_relaxed); }
+
+ private:
+   std::atomic<int> highest_{0};
+};
+
+// The highest escape count in a buffer; points that never escaped are left
+// out.
+int highest_escape(const Escape_buffer &escape);
+
+// A max_iter that looks deep enough for a view, from its zoom alone: it
+// grows with the number of halvings from the default view.
+int depth_iterations(const Viewport &viewport);
+
+// Chooses max_iter frame by frame, between minimum and maximum, so that
+// frames whose pixels all escape early are not iterated for longer than
+// they need.
+class Iteration_budget {
+ public:
+   Iteration_budget(int minimum, int maximum)
+       : minimum_(std::min(minimum, maximum)), maximum_(maximum),
+         limit_(maximum) {}
+
+   int limit() const { return limit_; }
+
+   // Starts a new view from depth_iterations().
+   void reset(const Viewport &viewport) {
+      limit_ = clamp(depth_iterations(viewport));
+   }
+
+   // Follows a frame whose highest escape count was highest. The new limit
+   // is twice that, so the same frame would come out identically with it,
+   // and a limit that the frame came close to doubles for the next one.
+   void update(int highest) {
+      limit_ = clamp(highest > maximum_ / 2 ? maximum_ : 2 * highest);
+   }
+
+ private:
+   int clamp(int limit) const {
+      return std::max(minimum_, std::min(limit, maximum_));
+   }
+
+   int minimum_;
+   int maximum_;
+   int limit_;
+};
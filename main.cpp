@@ -1,11 +1,42 @@
+#include "antialias.h"
+#include "escape_buffer.h"
+#include "escape_render.h"
+#include "escape_file.h"
+#include "escape_time.h"
+#include "frame.h"
+#include "frame_buffer.h"
+#include "frame_scheduler.h"
+#include "gpu_render.h"
+#include "image_file.h"
+#include "iteration_budget.h"
+#include "palette.h"
+#include "perturbation.h"
+#include "render.h"
+#include "temporal_cache.h"
+#include "thread_pool.h"
+#include "tile_cache.h"
+#include "tile_network.h"
+#include "trace.h"
+#include "view_cache.h"
+#include "viewport.h"
+
 #include <SDL.h>
 
-#include <cassert>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
 #include <complex>
+#include <cstdio>
+#include <deque>
+#include <fstream>
 #include <future>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 template <typename Struct, typename Constructor, typename Destructor,
@@ -29,155 +60,1365 @@ class Initialise_sdl {
    ~Initialise_sdl() { SDL_Quit(); }
 };
 
-template <typename Float_type, typename Int_type>
-Float_type NormalizeInt(Int_type int_value) {
-   return static_cast<Float_type>(int_value) *
-          (1.0 / static_cast<Float_type>(std::numeric_limits<Int_type>::max()));
+Colour gradient(double x, double y) { return Colour(x, y, 0); }
+
+// The pixel spacing of the first pass of a progressive render; each later
+// pass halves it.
+static constexpr size_t progressive_step = 8;
+
+// Tiles a --serve worker keeps in memory, 128 MiB of them.
+static constexpr size_t served_tiles = 256;
+
+// The lowest limit --adaptive-iterations chooses.
+static constexpr int adaptive_minimum_iter = 64;
+
+struct Options {
+   size_t num_threads = Thread_pool::default_num_threads();
+   // Fix each worker to a CPU, spread over the NUMA nodes.
+   bool pin_threads = false;
+   std::string isa;
+   size_t width = 2350;
+   size_t height = 1920;
+   // If set, render a single frame to this file without opening a window.
+   std::string output;
+   // Frame buffers in the window's ring; with more than one, the next frame
+   // is rendered while the current one is presented.
+   size_t textures = 2;
+   // Rotate the palette through a still view, without iterating it again.
+   bool cycle = false;
+   // Show a still view in passes of increasing resolution.
+   bool progressive = false;
+   // With --output, render this tile of the fixed tiling instead of the
+   // viewport, keeping tiles in tile_cache if set.
+   bool tiled = false;
+   Tile_key tile{Fractal_type::mandelbrot, 0.0, 0, 0, 0, 0};
+   std::string tile_cache;
+   // With tiled, the block of tiles from tile rightwards and downwards to
+   // render, fetched from workers, HOST:PORT, if there are any. A worker
+   // taking longer than worker_timeout seconds over a tile is dropped.
+   size_t tile_columns = 1;
+   size_t tile_rows = 1;
+   std::vector<std::string> workers;
+   double worker_timeout = 60;
+   // If set, render tiles for coordinators on serve_host:serve_port instead.
+   size_t serve_port = 0;
+   std::string serve_host = "127.0.0.1";
+   Fractal_type fractal = Fractal_type::julia;
+   Formula formula = Formula::z2;
+   Render_settings settings{Render_method::brute_force, default_viewport(),
+                            1000, Precision::automatic};
+   // Render the Mandelbrot set by perturbation, for zooms beyond the reach
+   // of double precision.
+   bool deep = false;
+   // Iterate and colour on an OpenCL GPU rather than on the thread pool.
+   bool gpu = false;
+   // Choose max_iter for each view and frame, up to settings.max_iter.
+   bool adaptive = false;
+   // If set, scale the Julia animation's resolution to render this many
+   // frames a second.
+   size_t target_fps = 0;
+   // If set, write the size and render time of every animation frame here.
+   std::string frame_log;
+   // If set, show tiles of the Julia animation whose escape counts have
+   // settled from their last render, rendering them only every temporal
+   // frames; implies adaptive.
+   size_t temporal = 0;
+   // If set, supersample still pixels on sharp edges with this many samples.
+   size_t antialias = 0;
+   // With sweep_frames set, render that many frames of the Julia animation
+   // from sweep_start up to sweep_end to the output pattern or, for "-", to
+   // standard output, with frames_in_flight frames rendering at once.
+   double sweep_start = 0;
+   double sweep_end = 0;
+   size_t sweep_frames = 0;
+   size_t frames_in_flight = 4;
+   // Render the --output image strip_rows rows at a time, writing each strip
+   // as it finishes, for images too large to hold in memory.
+   bool stream = false;
+   size_t strip_rows = default_tile_size;
+   // Colour by the continuous escape count, and shade escaped points within
+   // boundary pixels of the set; applied to the palette once parsed.
+   bool smooth = false;
+   double boundary = 0;
+   // If set, also keep the escape times of the --output image here, or
+   // colour those kept in load_escape instead of rendering.
+   std::string save_escape;
+   std::string load_escape;
+   // If set, record timed scopes and write them here as a Chrome trace.
+   std::string trace;
+   // Show each thread's load and the time spent presenting frames.
+   bool overlay = false;
+};
+
+size_t parse_size(const std::string &name, const char *value) {
+   try {
+      size_t pos = 0;
+      // std::stoul takes "-1" as ULONG_MAX; sizes start with a digit.
+      if (!std::isdigit(static_cast<unsigned char>(value[0])))
+         throw std::invalid_argument(value);
+      unsigned long result = std::stoul(value, &pos);
+      if (value[pos] == '\0')
+         return result;
+   } catch (const std::logic_error &) {
+   }
+   throw std::runtime_error("Invalid value for " + name + ": " + value);
+}
+
+// A --threads count, up to Thread_pool::max_threads.
+size_t parse_threads(const char *value) {
+   size_t result = parse_size("--threads", value);
+   if (result > Thread_pool::max_threads)
+      throw std::runtime_error("--threads must be at most " +
+                               std::to_string(Thread_pool::max_threads) +
+                               ": " + value);
+   return result;
+}
+
+// A --iterations count, which must fit max_iter.
+int parse_iterations(const char *value) {
+   size_t result = parse_size("--iterations", value);
+   if (result == 0 ||
+       result > static_cast<size_t>(std::numeric_limits<int>::max()))
+      throw std::runtime_error(std::string("--iterations must be between 1 "
+                                           "and ") +
+                               std::to_string(std::numeric_limits<int>::max()) +
+                               ": " + value);
+   return static_cast<int>(result);
+}
+
+// A --radius, which must be positive and finite.
+double parse_radius(const char *value) {
+   auto radius = static_cast<double>(parse_double_double(value));
+   if (!(radius > 0) || !std::isfinite(radius))
+      throw std::runtime_error(std::string("--radius must be positive: ") +
+                               value);
+   return radius;
+}
+
+void parse_image_size(const std::string &value, Options &options) {
+   size_t x = value.find('x');
+   if (x == std::string::npos)
+      throw std::runtime_error("Expected --size WIDTHxHEIGHT: " + value);
+   options.width = parse_size("--size", value.substr(0, x).c_str());
+   options.height = parse_size("--size", value.substr(x + 1).c_str());
+   if (options.width == 0 || options.height == 0)
+      throw std::runtime_error("Invalid value for --size: " + value);
+}
+
+// Parses LEVEL/X/Y.
+void parse_tile(const std::string &value, Options &options) {
+   size_t first = value.find('/');
+   size_t second = first == std::string::npos ? first
+                                              : value.find('/', first + 1);
+   if (second == std::string::npos)
+      throw std::runtime_error("Expected --tile LEVEL/X/Y: " + value);
+   Tile_key &tile = options.tile;
+   tile.level = static_cast<unsigned>(
+       parse_size("--tile", value.substr(0, first).c_str()));
+   tile.x = parse_size("--tile",
+                       value.substr(first + 1, second - first - 1).c_str());
+   tile.y = parse_size("--tile", value.substr(second + 1).c_str());
+   if (tile.level >= 64 || tile.x >> tile.level != 0 ||
+       tile.y >> tile.level != 0)
+      throw std::runtime_error("Tile out of range: " + value);
+   options.tiled = true;
+}
+
+// Parses [HOST:]PORT, HOST being loopback if left out.
+void parse_serve(const std::string &value, Options &options) {
+   size_t colon = value.rfind(':');
+   if (colon != std::string::npos) {
+      if (colon == 0)
+         throw std::runtime_error("Expected --serve [HOST:]PORT: " + value);
+      options.serve_host = value.substr(0, colon);
+   }
+   std::string port =
+       colon == std::string::npos ? value : value.substr(colon + 1);
+   options.serve_port = parse_size("--serve", port.c_str());
+   if (options.serve_port == 0 || options.serve_port > 65535)
+      throw std::runtime_error("Invalid value for --serve: " + value);
+}
+
+// Parses COLUMNSxROWS.
+void parse_tile_block(const std::string &value, Options &options) {
+   size_t x = value.find('x');
+   if (x == std::string::npos)
+      throw std::runtime_error("Expected --tiles COLUMNSxROWS: " + value);
+   options.tile_columns = parse_size("--tiles", value.substr(0, x).c_str());
+   options.tile_rows = parse_size("--tiles", value.substr(x + 1).c_str());
+   if (options.tile_columns == 0 || options.tile_rows == 0)
+      throw std::runtime_error("Invalid value for --tiles: " + value);
+}
+
+// Parses a comma-separated list of HOST:PORT.
+std::vector<std::string> parse_workers(const std::string &value) {
+   std::vector<std::string> workers;
+   size_t start = 0;
+   for (;;) {
+      size_t comma = value.find(',', start);
+      std::string worker = value.substr(start, comma - start);
+      size_t colon = worker.rfind(':');
+      if (colon == std::string::npos || colon == 0 ||
+          colon + 1 == worker.size())
+         throw std::runtime_error("Expected --workers HOST:PORT,...: " +
+                                  value);
+      parse_size("--workers", worker.substr(colon + 1).c_str());
+      workers.push_back(worker);
+      if (comma == std::string::npos)
+         return workers;
+      start = comma + 1;
+   }
+}
+
+Fractal_type parse_fractal(const std::string &name) {
+   if (name == "mandelbrot")
+      return Fractal_type::mandelbrot;
+   if (name == "julia")
+      return Fractal_type::julia;
+   throw std::runtime_error("Unknown fractal: " + name);
+}
+
+Formula parse_formula(const std::string &name) {
+   if (name == "z2")
+      return Formula::z2;
+   if (name == "z3")
+      return Formula::z3;
+   if (name == "z4")
+      return Formula::z4;
+   if (name == "burning-ship")
+      return Formula::burning_ship;
+   if (name == "tricorn")
+      return Formula::tricorn;
+   throw std::runtime_error("Unknown formula: " + name);
+}
+
+// Parses T0,T1,FRAMES.
+void parse_sweep(const std::string &value, Options &options) {
+   size_t first = value.find(',');
+   size_t second = first == std::string::npos ? first
+                                              : value.find(',', first + 1);
+   if (second == std::string::npos)
+      throw std::runtime_error("Expected --sweep T0,T1,FRAMES: " + value);
+   options.sweep_start =
+       static_cast<double>(parse_double_double(value.substr(0, first)));
+   options.sweep_end = static_cast<double>(
+       parse_double_double(value.substr(first + 1, second - first - 1)));
+   options.sweep_frames =
+       parse_size("--sweep", value.substr(second + 1).c_str());
+   if (options.sweep_frames == 0)
+      throw std::runtime_error("Invalid value for --sweep: " + value);
+}
+
+// The path of a frame of a sweep: pattern with its one %d, which may have a
+// zero-padded width such as %05d, replaced by the frame number.
+std::string frame_path(const std::string &pattern, size_t frame) {
+   size_t start = pattern.find('%');
+   size_t end = start;
+   if (start != std::string::npos)
+      end = pattern.find_first_not_of("0123456789", start + 1);
+   if (end == std::string::npos || pattern[end] != 'd' ||
+       pattern.find('%', end) != std::string::npos)
+      throw std::runtime_error("Expected one %d in the --output pattern: " +
+                               pattern);
+   std::string number = std::to_string(frame);
+   size_t width = end > start + 1
+                      ? parse_size("--output",
+                                   pattern.substr(start + 1, end - start - 1)
+                                       .c_str())
+                      : 0;
+   if (number.size() < width)
+      number.insert(0, width - number.size(), '0');
+   return pattern.substr(0, start) + number + pattern.substr(end + 1);
+}
+
+void parse_centre(const std::string &value, Viewport &viewport) {
+   size_t comma = value.find(',');
+   if (comma == std::string::npos)
+      throw std::runtime_error("Expected --centre RE,IM: " + value);
+   viewport.centre_re = parse_double_double(value.substr(0, comma));
+   viewport.centre_im = parse_double_double(value.substr(comma + 1));
+}
+
+Options parse_options(int argc, char *argv[]) {
+   Options options;
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--threads" && i + 1 < argc)
+         options.num_threads = parse_threads(argv[++i]);
+      else if (arg == "--pin-threads")
+         options.pin_threads = true;
+      else if (arg == "--isa" && i + 1 < argc)
+         options.isa = argv[++i];
+      else if (arg == "--size" && i + 1 < argc)
+         parse_image_size(argv[++i], options);
+      else if (arg == "--textures" && i + 1 < argc)
+         options.textures = parse_size(arg, argv[++i]);
+      else if (arg == "--output" && i + 1 < argc)
+         options.output = argv[++i];
+      else if (arg == "--method" && i + 1 < argc)
+         options.settings.method = parse_render_method(argv[++i]);
+      else if (arg == "--fractal" && i + 1 < argc)
+         options.fractal = parse_fractal(argv[++i]);
+      else if (arg == "--formula" && i + 1 < argc)
+         options.formula = parse_formula(argv[++i]);
+      else if (arg == "--centre" && i + 1 < argc)
+         parse_centre(argv[++i], options.settings.viewport);
+      else if (arg == "--radius" && i + 1 < argc)
+         options.settings.viewport.half_width =
+             options.settings.viewport.half_height = parse_radius(argv[++i]);
+      else if (arg == "--iterations" && i + 1 < argc)
+         options.settings.max_iter = parse_iterations(argv[++i]);
+      else if (arg == "--precision" && i + 1 < argc)
+         options.settings.precision = parse_precision(argv[++i]);
+      else if (arg == "--palette" && i + 1 < argc)
+         options.settings.palette = parse_palette(argv[++i]);
+      else if (arg == "--tile" && i + 1 < argc)
+         parse_tile(argv[++i], options);
+      else if (arg == "--tile-cache" && i + 1 < argc)
+         options.tile_cache = argv[++i];
+      else if (arg == "--tiles" && i + 1 < argc)
+         parse_tile_block(argv[++i], options);
+      else if (arg == "--workers" && i + 1 < argc)
+         options.workers = parse_workers(argv[++i]);
+      else if (arg == "--worker-timeout" && i + 1 < argc)
+         options.worker_timeout =
+             static_cast<double>(parse_double_double(argv[++i]));
+      else if (arg == "--serve" && i + 1 < argc)
+         parse_serve(argv[++i], options);
+      else if (arg == "--progressive")
+         options.progressive = true;
+      else if (arg == "--cycle")
+         options.cycle = true;
+      else if (arg == "--deep")
+         options.deep = true;
+      else if (arg == "--gpu")
+         options.gpu = true;
+      else if (arg == "--adaptive-iterations")
+         options.adaptive = true;
+      else if (arg == "--target-fps" && i + 1 < argc)
+         options.target_fps = parse_size(arg, argv[++i]);
+      else if (arg == "--frame-log" && i + 1 < argc)
+         options.frame_log = argv[++i];
+      else if (arg == "--temporal" && i + 1 < argc)
+         options.temporal = parse_size(arg, argv[++i]);
+      else if (arg == "--antialias" && i + 1 < argc)
+         options.antialias = parse_size(arg, argv[++i]);
+      else if (arg == "--sweep" && i + 1 < argc)
+         parse_sweep(argv[++i], options);
+      else if (arg == "--frames-in-flight" && i + 1 < argc)
+         options.frames_in_flight = parse_size(arg, argv[++i]);
+      else if (arg == "--stream")
+         options.stream = true;
+      else if (arg == "--strip-rows" && i + 1 < argc)
+         options.strip_rows = parse_size(arg, argv[++i]);
+      else if (arg == "--smooth")
+         options.smooth = true;
+      else if (arg == "--boundary" && i + 1 < argc)
+         options.boundary = static_cast<double>(parse_double_double(argv[++i]));
+      else if (arg == "--save-escape" && i + 1 < argc)
+         options.save_escape = argv[++i];
+      else if (arg == "--load-escape" && i + 1 < argc)
+         options.load_escape = argv[++i];
+      else if (arg == "--trace" && i + 1 < argc)
+         options.trace = argv[++i];
+      else if (arg == "--overlay")
+         options.overlay = true;
+      else
+         throw std::runtime_error("Unrecognised argument: " + arg);
+   }
+   if (options.textures == 0)
+      throw std::runtime_error("--textures must be at least 1");
+   options.settings.palette.smooth = options.smooth;
+   options.settings.palette.boundary = options.boundary;
+   options.settings.palette.degree = formula_degree(options.formula);
+   if (options.formula != Formula::z2 &&
+       (options.deep || options.gpu || options.tiled ||
+        options.serve_port != 0))
+      throw std::runtime_error("--formula cannot be used with --deep, --gpu, "
+                               "--tile or --serve");
+   if ((options.smooth || options.boundary != 0) && options.gpu)
+      throw std::runtime_error("--smooth and --boundary cannot be used with "
+                               "--gpu");
+   if (!(options.boundary >= 0))
+      throw std::runtime_error("--boundary must not be negative");
+   // Only renders that iterate and colour together keep distance estimates.
+   if (options.boundary != 0 &&
+       (options.deep || options.tiled || options.antialias != 0 ||
+        !options.load_escape.empty() || !options.save_escape.empty() ||
+        (options.output.empty() && options.fractal != Fractal_type::julia)))
+      throw std::runtime_error("--boundary applies to the Julia animation "
+                               "and to --output, without --deep, --tile, "
+                               "--antialias or escape files");
+   if (options.deep && options.fractal != Fractal_type::mandelbrot)
+      throw std::runtime_error("--deep requires --fractal mandelbrot");
+   if (options.tiled && (options.output.empty() || options.deep))
+      throw std::runtime_error("--tile requires --output, without --deep");
+   if ((options.tile_columns != 1 || options.tile_rows != 1 ||
+        !options.workers.empty()) &&
+       !options.tiled)
+      throw std::runtime_error("--tiles and --workers require --tile");
+   if (options.tiled &&
+       ((options.tile.x + options.tile_columns - 1) >> options.tile.level ||
+        (options.tile.y + options.tile_rows - 1) >> options.tile.level))
+      throw std::runtime_error("--tiles runs off the edge of the tiling");
+   if (!(options.worker_timeout > 0))
+      throw std::runtime_error("--worker-timeout must be positive");
+   if (options.progressive &&
+       (options.deep || options.fractal != Fractal_type::mandelbrot))
+      throw std::runtime_error("--progressive requires --fractal mandelbrot "
+                               "without --deep");
+   if (options.gpu &&
+       (options.deep || options.tiled || options.progressive ||
+        options.cycle ||
+        (options.output.empty() && options.fractal != Fractal_type::julia)))
+      throw std::runtime_error("--gpu renders the Julia animation or, with "
+                               "--output, one view, without --deep, --tile, "
+                               "--progressive or --cycle");
+   if (options.temporal != 0) {
+      if (options.temporal < 2)
+         throw std::runtime_error("--temporal must be at least 2");
+      if (!options.output.empty() || options.fractal != Fractal_type::julia ||
+          options.deep || options.gpu || options.target_fps != 0)
+         throw std::runtime_error("--temporal applies to the Julia animation "
+                                  "in the window, without --gpu or "
+                                  "--target-fps");
+      options.adaptive = true;
+   }
+   if (options.adaptive && (options.tiled || options.gpu))
+      throw std::runtime_error("--adaptive-iterations cannot be used with "
+                               "--tile or --gpu");
+   if (options.target_fps != 0 && options.gpu)
+      throw std::runtime_error("--target-fps cannot be used with --gpu");
+   if (options.sweep_frames != 0) {
+      if (options.output.empty() || options.fractal != Fractal_type::julia ||
+          options.tiled || options.deep || options.antialias != 0)
+         throw std::runtime_error("--sweep requires --output and the Julia "
+                                  "set, without --tile or --antialias");
+      if (options.output != "-")
+         frame_path(options.output, 0);
+      if (options.frames_in_flight == 0)
+         throw std::runtime_error("--frames-in-flight must be at least 1");
+   }
+   if (options.stream) {
+      if (options.output.empty() || options.output == "-" || options.tiled ||
+          options.deep || options.gpu || options.antialias != 0 ||
+          options.sweep_frames != 0)
+         throw std::runtime_error("--stream requires --output, without "
+                                  "--tile, --deep, --gpu, --antialias or "
+                                  "--sweep");
+      if (options.strip_rows == 0 || options.frames_in_flight == 0)
+         throw std::runtime_error("--strip-rows and --frames-in-flight must "
+                                  "be at least 1");
+   }
+   if (!options.save_escape.empty() &&
+       (options.output.empty() || options.gpu || options.stream ||
+        options.sweep_frames != 0))
+      throw std::runtime_error("--save-escape requires --output, without "
+                               "--gpu, --stream or --sweep");
+   if (!options.load_escape.empty() &&
+       (options.output.empty() || options.tiled || options.gpu ||
+        options.stream || options.sweep_frames != 0 ||
+        options.antialias != 0 || !options.save_escape.empty()))
+      throw std::runtime_error("--load-escape requires --output, without "
+                               "other rendering options");
+   if (options.antialias != 0) {
+      auto grid = static_cast<size_t>(
+          std::lround(std::sqrt(static_cast<double>(options.antialias))));
+      if (grid * grid != options.antialias)
+         throw std::runtime_error("--antialias needs a square, such as 4 or "
+                                  "16");
+      if (options.deep || options.tiled || options.gpu || options.cycle ||
+          (options.output.empty() &&
+           options.fractal == Fractal_type::julia))
+         throw std::runtime_error("--antialias applies to still views, "
+                                  "without --deep, --tile, --gpu or --cycle");
+   }
+   return options;
+}
+
+Render_settings frame_settings(const Options &options, size_t width,
+                               size_t height) {
+   Render_settings settings = options.settings;
+   settings.precision = resolve_precision(settings.precision,
+                                          settings.viewport, width, height);
+   settings.pixel_size =
+       2 * settings.viewport.half_width / static_cast<double>(width);
+   return settings;
 }
 
-template <typename Int_type, typename Float_type>
-Int_type DenormalizeInt(Float_type float_value) {
-   return static_cast<Int_type>(
-       float_value *
-       static_cast<Float_type>(std::numeric_limits<Int_type>::max()));
+// With --adaptive-iterations, sets the limit for a new view from its depth.
+void adapt_iterations(Options &options, Iteration_budget &budget) {
+   if (!options.adaptive)
+      return;
+   budget.reset(options.settings.viewport);
+   options.settings.max_iter = budget.limit();
 }
 
-struct Colour {
-   uint8_t red;
-   uint8_t green;
-   uint8_t blue;
+// A view that does not change over time: the Mandelbrot set, or the first
+// frame of the Julia animation.
+Fractal still_fractal(const Options &options) {
+   if (options.fractal == Fractal_type::mandelbrot)
+      return {Fractal_type::mandelbrot, 0.0, options.settings.max_iter,
+              options.formula};
+   return {Fractal_type::julia, julia_constant(0), options.settings.max_iter,
+           options.formula};
+}
 
-   Colour(uint8_t r, uint8_t g, uint8_t b) : red(r), green(g), blue(b) {}
+Escape_buffer render_still(Thread_pool &pool, const Options &options,
+                           size_t width, size_t height) {
+   Render_settings settings = frame_settings(options, width, height);
+   Escape_buffer escape(width, height,
+                        static_cast<uint32_t>(settings.max_iter));
+   if (options.deep) {
+      std::vector<int> iterations(width * height);
+      std::vector<double> norms(width * height);
+      render_perturbed(pool, settings.viewport, settings.max_iter, width,
+                       height, iterations.data(), norms.data());
+      store_escape(escape, 0, iterations.data(), norms.data(), width * height);
+   } else {
+      render_escape(pool, still_fractal(options), settings, escape);
+   }
+   return escape;
+}
 
-   Colour(double r, double g, double b)
-       : red(DenormalizeInt<uint8_t>(r)), green(DenormalizeInt<uint8_t>(g)),
-         blue(DenormalizeInt<uint8_t>(b)) {}
+// A frame of the Julia animation in flight, and what the main loop learns
+// about it once it has been presented.
+struct Frame_record {
+   size_t width;
+   size_t height;
+   double scale;
+   int max_iter;
+   std::shared_ptr<Escape_summary> summary =
+       std::make_shared<Escape_summary>();
+   std::shared_ptr<Frame_clock> clock = std::make_shared<Frame_clock>();
+   // The frame's number from Frame_generations, when it can be called off.
+   uint64_t generation = 0;
 };
 
-template <typename Func>
-void generate_pixels(uint8_t *buffer, size_t width, size_t height, size_t pitch,
-                     Func f) {
-   static size_t constexpr channels = 4;
-   auto loops = [buffer, width, height, pitch, f](size_t i_start,
-                                                  size_t i_end) {
-      for (size_t i = i_start; i < i_end; ++i) {
-         double y = static_cast<double>(i) / static_cast<double>(height);
-         for (size_t j = 0; j < width; ++j) {
-            uint8_t *address = buffer + i * pitch + j * channels;
-            double x = static_cast<double>(j) / static_cast<double>(width);
-            Colour c = f(x, y);
-            address[0] = 255;
-            address[1] = c.blue;
-            address[2] = c.green;
-            address[3] = c.red;
+// Starts rendering the Julia animation at time t into pixels, at the size
+// and limit in frame, on gpu if it is not null and otherwise on the pool.
+// The CPU gathers the frame's highest escape count and render time in
+// frame. If generations is given, tiles left once it has called the frame
+// off are skipped, and if temporal is, tiles go through it. The returned
+// future is ready once the frame is complete or called off; options,
+// generations and temporal must outlive it.
+std::future<void> submit_frame(Thread_pool &pool, Gpu_renderer *gpu,
+                               const Options &options, double t,
+                               const Frame_record &frame, uint8_t *pixels,
+                               size_t pitch,
+                               const Frame_generations *generations = nullptr,
+                               Temporal_cache *temporal = nullptr) {
+   Render_settings settings =
+       frame_settings(options, frame.width, frame.height);
+   settings.max_iter = frame.max_iter;
+   Fractal fractal{Fractal_type::julia, julia_constant(t), frame.max_iter,
+                   options.formula};
+   if (gpu != nullptr)
+      return gpu->submit(fractal, settings, pixels, frame.width, frame.height,
+                         pitch);
+   auto summary = frame.summary;
+   auto clock = frame.clock;
+   uint64_t generation = frame.generation;
+   return submit_tiles(pool, pixels, frame.width, frame.height, pitch,
+                       [fractal, settings, summary, clock, generations,
+                        generation, temporal](const Tile &tile,
+                                              const double *x,
+                                              const double *y, uint32_t *out,
+                                              size_t stride) {
+                          if (generations != nullptr &&
+                              !generations->live(generation))
+                             return;
+                          clock->tile_started();
+                          if (temporal != nullptr)
+                             temporal->tile(fractal, settings, generation,
+                                            tile, x, y, out, stride,
+                                            summary.get());
+                          else
+                             fractal_tile(fractal, settings, tile, x, y, out,
+                                          stride, summary.get());
+                          clock->tile_finished();
+                       });
+}
+
+// How long each stage of presenting a frame took, in seconds.
+struct Present_timing {
+   double wait = 0;
+   double upload = 0;
+   double copy = 0;
+   double present = 0;
+};
+
+// Draws each thread's recent share of time spent on tiles as a bar over the
+// top left of the window, and puts the last frame's stage timings in the
+// title. The busy times come from the trace, so tracing must be enabled.
+class Overlay {
+ public:
+   explicit Overlay(SDL_Window *window)
+       : window_(window), last_update_(Clock::now()) {}
+
+   void draw(SDL_Renderer *renderer, const Present_timing &timing) {
+      static constexpr double update_seconds = 0.25;
+      static constexpr int bar_width = 200;
+      auto now = Clock::now();
+      double elapsed =
+          std::chrono::duration<double>(now - last_update_).count();
+      if (elapsed >= update_seconds) {
+         std::vector<double> busy = thread_busy_seconds();
+         last_busy_.resize(busy.size());
+         fractions_.resize(busy.size());
+         double total = 0;
+         for (size_t k = 0; k < busy.size(); ++k) {
+            fractions_[k] =
+                std::min(1.0, (busy[k] - last_busy_[k]) / elapsed);
+            total += fractions_[k];
          }
+         last_busy_ = busy;
+         last_update_ = now;
+         char title[160];
+         std::snprintf(title, sizeof(title),
+                       "wait %.1f ms, upload %.1f ms, copy %.1f ms, present "
+                       "%.1f ms, threads busy %.0f%%",
+                       timing.wait * 1e3, timing.upload * 1e3,
+                       timing.copy * 1e3, timing.present * 1e3,
+                       busy.empty() ? 0.0 : 100 * total / busy.size());
+         SDL_SetWindowTitle(window_, title);
+      }
+
+      SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+      for (size_t k = 0; k < fractions_.size(); ++k) {
+         int y = 8 + 12 * static_cast<int>(k);
+         SDL_Rect back{8, y, bar_width, 8};
+         SDL_Rect bar{8, y, static_cast<int>(bar_width * fractions_[k]), 8};
+         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+         SDL_RenderFillRect(renderer, &back);
+         SDL_SetRenderDrawColor(renderer, fractions_[k] < 0.9 ? 255 : 0, 200,
+                                0, 255);
+         SDL_RenderFillRect(renderer, &bar);
       }
-   };
-   constexpr size_t num_threads = 3;
-   std::vector<std::future<void>> futures(num_threads);
-   for (int thread = 0; thread < num_threads; ++thread)
-      futures[thread] =
-          std::async(std::launch::async, loops, thread * height / num_threads,
-                     ((thread + 1) * height / num_threads));
-   for (auto &elem : futures)
-      elem.wait();
+   }
+
+ private:
+   using Clock = std::chrono::steady_clock;
+
+   SDL_Window *window_;
+   Clock::time_point last_update_;
+   std::vector<double> last_busy_;
+   std::vector<double> fractions_;
+};
+
+using Texture_ptr = std::unique_ptr<SDL_Texture, void (*)(SDL_Texture *)>;
+
+// A ring of frame buffers, so that later frames can be rendered into some of
+// them while the oldest one is uploaded and presented. Workers never write
+// into the texture itself: each finished frame is copied to it in one
+// SDL_UpdateTexture call.
+class Texture_ring {
+ public:
+   Texture_ring(SDL_Renderer *renderer, size_t size, size_t width,
+                size_t height)
+       : renderer_(renderer),
+         texture_(make_unique_ptr_sdl<SDL_Texture>(
+             &SDL_CreateTexture, &SDL_DestroyTexture, renderer,
+             SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, width,
+             height)),
+         frames_(size), areas_(size) {
+      for (size_t k = 0; k < size; ++k)
+         buffers_.emplace_back(width, height);
+   }
+
+   // Workers may still be writing into the buffers.
+   ~Texture_ring() {
+      for (auto &frame : frames_)
+         if (frame.valid())
+            frame.wait();
+   }
+
+   bool full() const { return in_flight_ == buffers_.size(); }
+
+   // Presents every frame still in flight.
+   void drain() {
+      while (in_flight_ > 0)
+         present();
+   }
+
+   // Starts a frame in the next free buffer with render(pixels, pitch),
+   // which returns a future for the frame. A frame smaller than the buffer
+   // fills its top left corner, and is stretched over the window.
+   template <typename Render>
+   void submit(Render render, size_t width, size_t height) {
+      Frame_buffer &buffer = buffers_[next_];
+      areas_[next_] = {0, 0, static_cast<int>(width),
+                       static_cast<int>(height)};
+      frames_[next_] = render(buffer.data(), buffer.pitch());
+      next_ = (next_ + 1) % buffers_.size();
+      ++in_flight_;
+   }
+
+   template <typename Render>
+   void submit(Render render) {
+      submit(render, buffers_[next_].width(), buffers_[next_].height());
+   }
+
+   // Drawn over every frame after this, if not null.
+   void set_overlay(Overlay *overlay) { overlay_ = overlay; }
+
+   // Places the buffers' pages by first_touch(), before any frame.
+   void first_touch(Thread_pool &pool) {
+      for (Frame_buffer &buffer : buffers_)
+         ::first_touch(pool, buffer.data(), buffer.width(), buffer.height(),
+                       buffer.pitch());
+   }
+
+   // Waits up to timeout for the oldest frame in flight, and returns
+   // whether it is finished or, like the GPU's deferred frames, cannot be
+   // waited on for a time. The wait counts towards the next present().
+   bool wait_oldest(std::chrono::milliseconds timeout) {
+      Trace_scope scope("wait");
+      auto start = std::chrono::steady_clock::now();
+      bool ready = frames_[slot(0)].wait_for(timeout) !=
+                   std::future_status::timeout;
+      waited_ += std::chrono::steady_clock::now() - start;
+      return ready;
+   }
+
+   // Whether the frame k after the oldest in flight is finished.
+   bool finished(size_t k) const {
+      return frames_[slot(k)].wait_for(std::chrono::seconds(0)) ==
+             std::future_status::ready;
+   }
+
+   // Waits for the oldest frame in flight and drops it unpresented.
+   void discard() {
+      frames_[slot(0)].get();
+      --in_flight_;
+   }
+
+   // Waits for the oldest frame in flight, then uploads and presents it.
+   void present() {
+      using Clock = std::chrono::steady_clock;
+      size_t oldest = slot(0);
+      --in_flight_;
+      auto start = Clock::now() - waited_;
+      waited_ = Clock::duration::zero();
+      {
+         Trace_scope scope("wait");
+         frames_[oldest].get();
+      }
+      auto waited = Clock::now();
+      {
+         Trace_scope scope("upload");
+         const Frame_buffer &buffer = buffers_[oldest];
+         if (SDL_UpdateTexture(texture_.get(), &areas_[oldest], buffer.data(),
+                               static_cast<int>(buffer.pitch())) != 0)
+            throw std::runtime_error(SDL_GetError());
+      }
+      auto uploaded = Clock::now();
+      {
+         Trace_scope scope("copy");
+         SDL_RenderClear(renderer_);
+         SDL_RenderCopy(renderer_, texture_.get(), &areas_[oldest], nullptr);
+         if (overlay_ != nullptr)
+            overlay_->draw(renderer_, timing_);
+      }
+      auto copied = Clock::now();
+      {
+         Trace_scope scope("present");
+         SDL_RenderPresent(renderer_);
+      }
+      auto seconds = [](Clock::duration d) {
+         return std::chrono::duration<double>(d).count();
+      };
+      timing_ = {seconds(waited - start), seconds(uploaded - waited),
+                 seconds(copied - uploaded), seconds(Clock::now() - copied)};
+   }
+
+   // The stages of the last present().
+   const Present_timing &timing() const { return timing_; }
+
+ private:
+   // The buffer of the frame k after the oldest in flight.
+   size_t slot(size_t k) const {
+      return (next_ + buffers_.size() - in_flight_ + k) % buffers_.size();
+   }
+
+   SDL_Renderer *renderer_;
+   Texture_ptr texture_;
+   std::vector<Frame_buffer> buffers_;
+   std::vector<std::future<void>> frames_;
+   std::vector<SDL_Rect> areas_;
+   size_t next_ = 0;
+   size_t in_flight_ = 0;
+   Overlay *overlay_ = nullptr;
+   Present_timing timing_;
+   std::chrono::steady_clock::duration waited_{};
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                        start)
+       .count();
 }
 
-Colour gradient(double x, double y) { return Colour(x, y, 0); }
+// Starts colouring the cached view into the next buffer of the ring.
+void submit_still(Thread_pool &pool, const Options &options,
+                  const View_cache &cache, Texture_ring &ring, uint32_t shift,
+                  size_t step = 1) {
+   const Escape_buffer *escape = &cache.escape();
+   ring.submit([&pool, &options, escape, shift, step](uint8_t *pixels,
+                                                      size_t pitch) {
+      return submit_colouring(pool, *escape, options.settings.palette, shift,
+                              pixels, pitch, step);
+   });
+}
+
+// Starts colouring the cached view into the next buffer of the ring,
+// supersampling its edges.
+void submit_antialiased_still(Thread_pool &pool, const Options &options,
+                              const View_cache &cache, Texture_ring &ring) {
+   const Escape_buffer *escape = &cache.escape();
+   Render_settings settings =
+       frame_settings(options, escape->width, escape->height);
+   Fractal fractal = still_fractal(options);
+   ring.submit([&pool, &options, escape, settings, fractal](uint8_t *pixels,
+                                                           size_t pitch) {
+      return submit_antialiasing(pool, fractal, settings, *escape,
+                                 options.antialias, pixels, pitch);
+   });
+}
+
+// Iterates every pixel of the cached view in progressive passes, presenting
+// after each. If blocky, each pass is shown as blocks of its own samples;
+// otherwise pixels not yet iterated keep whatever the buffer held, such as
+// the placeholder left by a zoom.
+void refine(Thread_pool &pool, const Options &options, View_cache &cache,
+            Texture_ring &ring, bool blocky) {
+   const Escape_buffer &escape = cache.escape();
+   Render_settings settings =
+       frame_settings(options, escape.width, escape.height);
+   for (size_t step = progressive_step, previous = 0; step > 0;
+        previous = step, step /= 2) {
+      render_escape_pass(pool, still_fractal(options), settings, step,
+                         previous, cache.escape());
+      submit_still(pool, options, cache, ring, 0, blocky ? step : 1);
+      ring.drain();
+   }
+}
+
+// Shows a still view until the window closes. Dragging with the left
+// button pans it, reusing the escape times still in view, and the wheel
+// zooms about the pointer.
+void show_still(Thread_pool &pool, Options &options, Iteration_budget &budget,
+                Texture_ring &ring) {
+   static constexpr double zoom_step = 0.5;
+   size_t width = options.width;
+   size_t height = options.height;
+   View_cache cache(
+       Escape_buffer(width, height,
+                     static_cast<uint32_t>(options.settings.max_iter)),
+       options.settings.viewport);
+   if (options.progressive)
+      refine(pool, options, cache, ring, true);
+   else
+      cache.escape() = render_still(pool, options, width, height);
+   // Perturbation needs the whole image at once, so deep views stay put.
+   bool navigable = !options.deep;
+
+   auto start_time = std::chrono::steady_clock::now();
+   bool quit = false;
+   // Progressive passes are shown as they finish, but not antialiased.
+   bool changed = !options.progressive || options.antialias != 0;
+   long pan_x = 0, pan_y = 0;
+   int zoom = 0;
+   while (!quit) {
+      if (changed || options.cycle) {
+         auto shift = static_cast<uint32_t>(seconds_since(start_time) * 64);
+         while (!ring.full()) {
+            if (options.antialias != 0)
+               submit_antialiased_still(pool, options, cache, ring);
+            else
+               submit_still(pool, options, cache, ring, shift);
+         }
+         ring.present();
+         changed = false;
+      }
+
+      SDL_Event event;
+      bool pending = options.cycle ? SDL_PollEvent(&event) != 0
+                                   : SDL_WaitEvent(&event) != 0;
+      if (!pending && !options.cycle)
+         quit = true;
+      for (; pending; pending = SDL_PollEvent(&event) != 0) {
+         if (event.type == SDL_QUIT) {
+            quit = true;
+         } else if (event.type == SDL_MOUSEMOTION &&
+                    (event.motion.state & SDL_BUTTON_LMASK)) {
+            pan_x += event.motion.xrel;
+            pan_y += event.motion.yrel;
+         } else if (event.type == SDL_MOUSEWHEEL) {
+            zoom += event.wheel.y;
+         }
+      }
+      if (quit || !navigable || (pan_x == 0 && pan_y == 0 && zoom == 0))
+         continue;
 
-Colour mandelbrot(double x, double y) {
-   auto c = std::complex<double>((x * 4.0) - 2.0, (y * 4.0) - 2.0);
-   auto v = std::complex<double>(0, 0);
-   int i = 0;
-   for (; i < 1000 && std::abs(v) < 2.0; ++i)
-      v = v * v + c;
-   double i_scaled = std::min(1.0, static_cast<double>(i) / 200);
-   if (std::abs(v) > 2.0)
-      return {i_scaled, i_scaled, i_scaled};
-   return {0.0, 0.0, 0.0};
+      // Frames still in flight read the buffer that is about to change.
+      ring.drain();
+      if (pan_x != 0 || pan_y != 0) {
+         cache.pan(pool, still_fractal(options),
+                   frame_settings(options, width, height), pan_x, pan_y);
+         options.settings.viewport = cache.viewport();
+         pan_x = pan_y = 0;
+      }
+      if (zoom != 0) {
+         int mouse_x = 0, mouse_y = 0;
+         SDL_GetMouseState(&mouse_x, &mouse_y);
+         cache.zoom(std::pow(zoom_step, zoom),
+                    static_cast<double>(mouse_x) / static_cast<double>(width),
+                    static_cast<double>(mouse_y) /
+                        static_cast<double>(height));
+         options.settings.viewport = cache.viewport();
+         zoom = 0;
+         // The placeholders may hold counts up to the old limit.
+         adapt_iterations(options, budget);
+         Escape_buffer &escape = cache.escape();
+         escape.max_iter = std::max(
+             escape.max_iter, static_cast<uint32_t>(options.settings.max_iter));
+         submit_still(pool, options, cache, ring, 0);
+         ring.drain();
+         refine(pool, options, cache, ring, false);
+         escape.max_iter = static_cast<uint32_t>(options.settings.max_iter);
+      }
+      changed = true;
+   }
 }
 
-Colour julia(std::complex<double> v, std::complex<double> c) {
-   int i = 0;
-   for (; i < 1000 && std::abs(v) < 2.0; ++i)
-      v = v * v + c;
-   double i_scaled = std::min(1.0, static_cast<double>(i) / 200);
-   if (std::abs(v) > 2.0)
-      return {i_scaled, i_scaled, i_scaled};
-   return {0.0, 0.0, 0.0};
+// Renders one frame into memory and writes it out; SDL is never initialised,
+// so this works without a display.
+// What the --output image is rendered from, for --save-escape.
+Escape_file_info escape_file_info(const Options &options) {
+   if (!options.tiled) {
+      Render_settings settings =
+          frame_settings(options, options.width, options.height);
+      return {still_fractal(options), settings.viewport, settings.precision};
+   }
+   Viewport viewport = tile_viewport(options.tile);
+   double span = 2 * viewport.half_width;
+   viewport.half_width *= static_cast<double>(options.tile_columns);
+   viewport.half_height *= static_cast<double>(options.tile_rows);
+   viewport.centre_re = viewport.centre_re + (viewport.half_width - span / 2);
+   viewport.centre_im =
+       viewport.centre_im + (viewport.half_height - span / 2);
+   size_t width = options.tile_columns * Tile_cache::tile_pixels;
+   size_t height = options.tile_rows * Tile_cache::tile_pixels;
+   return {still_fractal(options), viewport,
+           choose_precision(viewport, width, height)};
 }
 
-Colour animate_julia(double x, double y, double t) {
-   return julia(std::complex<double>((x * 4.0) - 2.0, (y * 4.0) - 2.0),
-                0.7885 * std::exp(t * std::complex<double>(0, 1)));
+// Colours the escape times of --load-escape, in place in the mapped file,
+// into the --output image.
+void recolour_escape_file(Thread_pool &pool, const Options &options) {
+   Mapped_escape_file file(options.load_escape);
+   const Escape_planes &escape = file.planes();
+   Palette palette = options.settings.palette;
+   palette.degree = formula_degree(file.info().fractal.formula);
+   Frame_buffer frame(escape.width, escape.height);
+   submit_colouring(pool, escape, palette, 0, frame.data(), frame.pitch())
+       .get();
+   write_image(options.output, frame.pixels(), frame.width(), frame.height(),
+               frame.pitch() / sizeof(uint32_t));
 }
 
-int main(int argc, char *argv[]) {
-   static constexpr size_t image_width = 2350;
-   static constexpr size_t image_height = 1920;
-   try {
-      Initialise_sdl(SDL_INIT_VIDEO);
-
-      auto window = make_unique_ptr_sdl<SDL_Window>(
-          &SDL_CreateWindow, &SDL_DestroyWindow, "Hello World!", 30, 30,
-          image_width, image_height, SDL_WINDOW_SHOWN);
-
-      auto renderer = make_unique_ptr_sdl<SDL_Renderer>(
-          &SDL_CreateRenderer, &SDL_DestroyRenderer, window.get(), -1,
-          SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-
-      SDL_RenderClear(renderer.get());
-      SDL_RenderPresent(renderer.get());
-
-      auto texture = make_unique_ptr_sdl<SDL_Texture>(
-          &SDL_CreateTexture, &SDL_DestroyTexture, renderer.get(),
-          SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, image_width,
-          image_height);
-      uint8_t *pixels = nullptr;
-      int pitch = 0;
-      SDL_LockTexture(texture.get(), nullptr,
-                      reinterpret_cast<void **>(&pixels), &pitch);
-      assert(pitch == image_width * sizeof(uint32_t));
-      generate_pixels(
-          pixels, image_width, image_height, pitch,
-          [](double x, double y) { return animate_julia(x, y, 0); });
-      SDL_UnlockTexture(texture.get());
-
-      SDL_RenderClear(renderer.get());
-      SDL_RenderCopy(renderer.get(), texture.get(), nullptr, nullptr);
-      SDL_RenderPresent(renderer.get());
-
-      auto start_time = std::chrono::steady_clock::now();
-      bool quit = false;
-      while (!quit) {
-         double t = static_cast<double>(
-                        std::chrono::duration_cast<std::chrono::milliseconds>(
-                            std::chrono::steady_clock::now() - start_time)
-                            .count()) *
-                    0.0001;
-         uint8_t *pixels = nullptr;
-         int pitch = 0;
-         SDL_LockTexture(texture.get(), nullptr,
-                         reinterpret_cast<void **>(&pixels), &pitch);
-         assert(pitch == image_width * sizeof(uint32_t));
-         generate_pixels(
-             pixels, image_width, image_height, pitch,
-             [t](double x, double y) { return animate_julia(x, y, t); });
-
-         SDL_UnlockTexture(texture.get());
-         SDL_RenderClear(renderer.get());
-         SDL_RenderCopy(renderer.get(), texture.get(), nullptr, nullptr);
-         SDL_RenderPresent(renderer.get());
+void render_to_file(Thread_pool &pool, const Options &options) {
+   if (options.gpu) {
+      Gpu_renderer gpu;
+      Frame_buffer frame(options.width, options.height);
+      gpu.submit(still_fractal(options),
+                 frame_settings(options, options.width, options.height),
+                 frame.data(), frame.width(), frame.height(), frame.pitch())
+          .get();
+      write_image(options.output, frame.pixels(), frame.width(),
+                  frame.height(), frame.pitch() / sizeof(uint32_t));
+      return;
+   }
+   if (options.settings.palette.boundary > 0) {
+      // Distance estimates are only kept while a tile is coloured.
+      Frame_buffer frame(options.width, options.height);
+      Render_settings settings =
+          frame_settings(options, options.width, options.height);
+      Fractal fractal = still_fractal(options);
+      submit_tiles(pool, frame.data(), frame.width(), frame.height(),
+                   frame.pitch(),
+                   [fractal, settings](const Tile &tile, const double *x,
+                                       const double *y, uint32_t *out,
+                                       size_t stride) {
+                      fractal_tile(fractal, settings, tile, x, y, out, stride);
+                   })
+          .get();
+      write_image(options.output, frame.pixels(), frame.width(),
+                  frame.height(), frame.pitch() / sizeof(uint32_t));
+      return;
+   }
+
+   std::shared_ptr<const Escape_buffer> escape;
+   if (options.tiled) {
+      Tile_key key = options.tile;
+      key.type = options.fractal;
+      key.c = julia_constant(0);
+      key.max_iter = options.settings.max_iter;
+      Tile_cache cache(pool, 1, options.tile_cache);
+      std::vector<Worker_stats> workers;
+      escape = std::make_shared<Escape_buffer>(render_tile_block(
+          cache, options.workers, key, options.tile_columns, options.tile_rows,
+          options.worker_timeout, &workers));
+      Tile_cache_stats stats = cache.stats();
+      std::cerr << "Tile cache: " << stats.hits << " hits, " << stats.disk_hits
+                << " disk hits, " << stats.misses << " misses" << std::endl;
+      for (const Worker_stats &worker : workers)
+         std::cerr << worker.address << ": " << worker.tiles << " tiles"
+                   << (worker.failed ? ", then dropped" : "") << std::endl;
+   } else {
+      escape = std::make_shared<Escape_buffer>(
+          render_still(pool, options, options.width, options.height));
+   }
+   if (!options.save_escape.empty())
+      write_escape_file(options.save_escape, escape_file_info(options),
+                        *escape);
+   Frame_buffer frame(escape->width, escape->height);
+   if (options.antialias != 0)
+      submit_antialiasing(pool, still_fractal(options),
+                          frame_settings(options, frame.width(),
+                                         frame.height()),
+                          *escape, options.antialias, frame.data(),
+                          frame.pitch())
+          .get();
+   else
+      submit_colouring(pool, *escape, options.settings.palette, 0,
+                       frame.data(), frame.pitch())
+          .get();
+   write_image(options.output, frame.pixels(), frame.width(), frame.height(),
+               frame.pitch() / sizeof(uint32_t));
+}
+
+// A buffer of a sweep or a streamed image, which is rendered into and then
+// written out while later frames or strips render into others.
+struct Sweep_slot {
+   Sweep_slot(size_t width, size_t height) : buffer(width, height) {}
+   Sweep_slot(Sweep_slot &&) = default;
+
+   // Workers may still be using the buffer if the sweep failed.
+   ~Sweep_slot() {
+      if (rendered.valid())
+         rendered.wait();
+      if (written.valid())
+         written.wait();
+   }
+
+   Frame_buffer buffer;
+   std::future<void> rendered;
+   std::future<void> written;
+};
 
+// Writes a frame of raw pixels straight from its buffer.
+void write_raw(const Frame_buffer &frame) {
+   size_t row = frame.width() * sizeof(uint32_t);
+   bool packed = row == frame.pitch();
+   for (size_t y = 0; y < (packed ? 1 : frame.height()); ++y) {
+      size_t size = packed ? row * frame.height() : row;
+      if (std::fwrite(frame.data() + y * frame.pitch(), 1, size, stdout) !=
+          size)
+         throw std::runtime_error("Cannot write to standard output");
+   }
+}
+
+// Renders every frame of a --sweep. Up to frames_in_flight frames iterate on
+// the pool at once, each iterated and coloured in one pass over its tiles;
+// finished frames are then encoded on the pool too, or written in order to
+// standard output, while later frames render.
+void render_sweep(Thread_pool &pool, Gpu_renderer *gpu,
+                  const Options &options) {
+   bool pipe = options.output == "-";
+   size_t frames = options.sweep_frames;
+   size_t in_flight = options.frames_in_flight;
+   // Twice as many buffers as frames in flight, so that a frame's encoding
+   // has as long as the frames after it take to render before its buffer
+   // is needed again.
+   std::vector<Sweep_slot> slots;
+   for (size_t k = 0; k < std::min(2 * in_flight, frames); ++k) {
+      slots.emplace_back(options.width, options.height);
+      Frame_buffer &buffer = slots.back().buffer;
+      if (pool.nodes() > 1)
+         first_touch(pool, buffer.data(), buffer.width(), buffer.height(),
+                     buffer.pitch());
+   }
+
+   auto start_time = std::chrono::steady_clock::now();
+   size_t submitted = 0;
+   for (size_t finished = 0; finished < frames; ++finished) {
+      for (; submitted < frames && submitted < finished + in_flight;
+           ++submitted) {
+         Sweep_slot &slot = slots[submitted % slots.size()];
+         if (slot.written.valid())
+            slot.written.get();
+         double t = options.sweep_start +
+                    (options.sweep_end - options.sweep_start) *
+                        static_cast<double>(submitted) /
+                        static_cast<double>(frames);
+         Frame_record frame{options.width, options.height, 1.0,
+                            options.settings.max_iter};
+         slot.rendered = submit_frame(pool, gpu, options, t, frame,
+                                      slot.buffer.data(), slot.buffer.pitch());
+      }
+
+      Sweep_slot &slot = slots[finished % slots.size()];
+      slot.rendered.get();
+      if (pipe) {
+         write_raw(slot.buffer);
+         continue;
+      }
+      const Frame_buffer *buffer = &slot.buffer;
+      std::string path = frame_path(options.output, finished);
+      slot.written = pool.submit(1, [buffer, path](size_t, size_t) {
+         Trace_scope scope("encode");
+         write_image(path, buffer->pixels(), buffer->width(),
+                     buffer->height(), buffer->pitch() / sizeof(uint32_t));
+      });
+   }
+   for (Sweep_slot &slot : slots)
+      if (slot.written.valid())
+         slot.written.get();
+   if (pipe && std::fflush(stdout) != 0)
+      throw std::runtime_error("Cannot write to standard output");
+
+   double seconds = seconds_since(start_time);
+   std::cerr << "Rendered " << frames << " frames in " << seconds << " s, "
+             << static_cast<double>(frames) / seconds << " frames/s"
+             << std::endl;
+}
+
+// Renders the --output image --strip-rows rows at a time, holding at most
+// frames_in_flight strips: each strip is iterated and coloured in one pass
+// over its tiles, then written in order while the strips after it render.
+void render_streamed(Thread_pool &pool, const Options &options) {
+   size_t width = options.width;
+   size_t height = options.height;
+   // No taller than the image, so that a large --strip-rows cannot size the
+   // slots past what one strip needs.
+   size_t rows = std::min(options.strip_rows, height);
+   size_t strips = (height + rows - 1) / rows;
+   Render_settings settings = frame_settings(options, width, height);
+   Fractal fractal = still_fractal(options);
+   std::vector<Sweep_slot> slots;
+   for (size_t k = 0; k < std::min(options.frames_in_flight, strips); ++k)
+      slots.emplace_back(width, rows);
+
+   Image_stream image(options.output, width, height);
+   size_t submitted = 0;
+   for (size_t finished = 0; finished < strips; ++finished) {
+      for (; submitted < strips && submitted < finished + slots.size();
+           ++submitted) {
+         Sweep_slot &slot = slots[submitted % slots.size()];
+         size_t first_row = submitted * rows;
+         slot.rendered = submit_band(
+             pool, slot.buffer.data(), width, height, first_row,
+             std::min(rows, height - first_row), slot.buffer.pitch(),
+             [fractal, settings](const Tile &tile, const double *x,
+                                 const double *y, uint32_t *out,
+                                 size_t stride) {
+                fractal_tile(fractal, settings, tile, x, y, out, stride);
+             });
+      }
+
+      Sweep_slot &slot = slots[finished % slots.size()];
+      slot.rendered.get();
+      Trace_scope scope("write");
+      image.write_rows(slot.buffer.pixels(),
+                       std::min(rows, height - finished * rows),
+                       slot.buffer.pitch() / sizeof(uint32_t));
+   }
+   image.finish();
+}
+
+// Opens a window and shows the Julia animation, or a still view, until it
+// is closed.
+void show_window(Thread_pool &pool, Options &options,
+                 Iteration_budget &budget) {
+   Initialise_sdl sdl(SDL_INIT_VIDEO);
+   const size_t image_width = options.width;
+   const size_t image_height = options.height;
+
+   auto window = make_unique_ptr_sdl<SDL_Window>(
+       &SDL_CreateWindow, &SDL_DestroyWindow, "Hello World!", 30, 30,
+       image_width, image_height, SDL_WINDOW_SHOWN);
+
+   auto renderer = make_unique_ptr_sdl<SDL_Renderer>(
+       &SDL_CreateRenderer, &SDL_DestroyRenderer, window.get(), -1,
+       SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+
+   SDL_RenderClear(renderer.get());
+   SDL_RenderPresent(renderer.get());
+
+   // Only the Julia set changes from frame to frame. Other views are
+   // iterated once, then recoloured only when panned, zoomed or, with
+   // --cycle, on every frame.
+   bool julia = options.fractal == Fractal_type::julia && !options.deep;
+   bool animated = julia || options.cycle;
+   // Smooth the upscaling of frames rendered below full size.
+   if (options.target_fps != 0)
+      SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+   // Declared before the ring, which may hold frames they are rendering.
+   Frame_generations generations;
+   std::unique_ptr<Temporal_cache> temporal;
+   if (options.temporal != 0)
+      temporal.reset(new Temporal_cache(image_width, image_height,
+                                        default_tile_size,
+                                        static_cast<unsigned>(
+                                            options.temporal)));
+   std::unique_ptr<Gpu_renderer> gpu;
+   if (options.gpu) {
+      gpu.reset(new Gpu_renderer);
+      std::cerr << "Rendering on " << gpu->device_name() << std::endl;
+   }
+   Texture_ring ring(renderer.get(), animated ? options.textures : 1,
+                     image_width, image_height);
+   if (pool.nodes() > 1)
+      ring.first_touch(pool);
+   Overlay overlay(window.get());
+   if (options.overlay)
+      ring.set_overlay(&overlay);
+   if (!julia) {
+      show_still(pool, options, budget, ring);
+      return;
+   }
+
+   Frame_scheduler scheduler(
+       options.target_fps != 0 ? 1.0 / options.target_fps : 0.0);
+   std::ofstream frame_log;
+   if (!options.frame_log.empty()) {
+      frame_log.open(options.frame_log);
+      if (!frame_log)
+         throw std::runtime_error("Cannot write " + options.frame_log);
+      frame_log << "frame,width,height,scale,max_iter,render_ms\n";
+   }
+   // Oldest first.
+   std::deque<Frame_record> in_flight;
+   size_t presented = 0;
+   auto start_time = std::chrono::steady_clock::now();
+   bool quit = false;
+   while (!quit) {
+      while (!ring.full()) {
+         double t = seconds_since(start_time) * 0.1;
+         Frame_record frame{scheduler.scaled(image_width),
+                            scheduler.scaled(image_height),
+                            scheduler.scale(), options.settings.max_iter};
+         frame.generation = generations.start();
+         in_flight.push_back(frame);
+         ring.submit(
+             [&pool, &gpu, &options, &generations, &temporal, t,
+              frame](uint8_t *pixels, size_t pitch) {
+                return submit_frame(pool, gpu.get(), options, t, frame,
+                                    pixels, pitch, &generations,
+                                    temporal.get());
+             },
+             frame.width, frame.height);
+      }
+
+      // Keep answering events while the oldest frame renders. Quitting
+      // calls off every frame in flight, and a newer frame finishing first
+      // calls off those before it, whose t it has overtaken.
+      size_t overtaken = 0;
+      while (!quit && overtaken == 0 &&
+             !ring.wait_oldest(std::chrono::milliseconds(2))) {
          SDL_Event event;
          while (SDL_PollEvent(&event))
             if (event.type == SDL_QUIT)
                quit = true;
+         for (size_t k = in_flight.size() - 1; k > 0 && overtaken == 0; --k)
+            if (ring.finished(k))
+               overtaken = k;
+      }
+      if (quit)
+         break;
+      if (overtaken != 0) {
+         generations.cancel_before(in_flight[overtaken].generation);
+         for (; overtaken > 0; --overtaken) {
+            ring.discard();
+            in_flight.pop_front();
+         }
+      }
+      ring.present();
+
+      const Frame_record &frame = in_flight.front();
+      double seconds = frame.clock->seconds();
+      if (options.target_fps != 0)
+         scheduler.record({frame.width, frame.height, frame.scale, seconds});
+      if (options.adaptive) {
+         budget.update(frame.summary->highest());
+         options.settings.max_iter = budget.limit();
+      }
+      if (frame_log.is_open())
+         frame_log << presented << ',' << frame.width << ','
+                   << frame.height << ',' << frame.scale << ','
+                   << frame.max_iter << ',' << seconds * 1e3 << '\n';
+      ++presented;
+      in_flight.pop_front();
+
+      SDL_Event event;
+      while (SDL_PollEvent(&event))
+         if (event.type == SDL_QUIT)
+            quit = true;
+   }
+   // Leaves the ring only the tiles already rendering to wait for.
+   generations.cancel_all();
+   if (temporal != nullptr)
+      std::cerr << "Reused " << temporal->reused() << " of "
+                << temporal->reused() + temporal->rendered() << " tiles"
+                << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+   try {
+      Options options = parse_options(argc, argv);
+      // Before the pool starts, so that every worker is traced.
+      if (!options.trace.empty() || options.overlay)
+         enable_tracing();
+      Thread_pool pool(options.num_threads,
+                       options.pin_threads ? Thread_placement::pinned
+                                           : Thread_placement::floating);
+      if (!options.isa.empty())
+         select_escape_time_isa(options.isa);
+      Iteration_budget budget(adaptive_minimum_iter,
+                              options.settings.max_iter);
+      adapt_iterations(options, budget);
+      if (options.serve_port != 0) {
+         Tile_cache cache(pool, served_tiles, options.tile_cache);
+         serve_tiles(cache, options.serve_host,
+                     static_cast<uint16_t>(options.serve_port),
+                     options.settings.max_iter);
+      } else if (options.sweep_frames != 0) {
+         std::unique_ptr<Gpu_renderer> gpu;
+         if (options.gpu)
+            gpu.reset(new Gpu_renderer);
+         render_sweep(pool, gpu.get(), options);
+      } else if (!options.load_escape.empty()) {
+         recolour_escape_file(pool, options);
+      } else if (options.stream) {
+         render_streamed(pool, options);
+      } else if (!options.output.empty()) {
+         render_to_file(pool, options);
+      } else {
+         show_window(pool, options, budget);
       }
+      if (!options.trace.empty())
+         write_trace(options.trace);
    } catch (const std::runtime_error &e) {
       std::cerr << e.what() << std::endl;
       SDL_Quit();
       return 1;
+   } catch (const std::bad_alloc &) {
+      // Most likely a colour table for a --iterations too large to hold.
+      std::cerr << "Out of memory" << std::endl;
+      SDL_Quit();
+      return 1;
    }
 
    return 0;
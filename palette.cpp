@@ -0,0 +1,111 @@
+#include "palette.h"
+#include "render.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+namespace {
+
+// Colouring does so little work per pixel that it is bound by memory
+// traffic, which favours longer rows than iterating does.
+constexpr size_t colouring_tile_size = 256;
+
+} // namespace
+
+Palette grey_palette() {
+   static constexpr uint32_t steps = 200;
+   Palette palette{{}, false, pack_rgba8888(0, 0, 0)};
+   for (uint32_t i = 0; i <= steps; ++i) {
+      uint8_t grey = DenormalizeInt<uint8_t>(static_cast<double>(i) / steps);
+      palette.colours.push_back(pack_rgba8888(grey, grey, grey));
+   }
+   return palette;
+}
+
+Palette rainbow_palette() {
+   static constexpr size_t size = 256;
+   static const double pi = std::acos(-1.0);
+   Palette palette{{}, true, pack_rgba8888(0, 0, 0)};
+   for (size_t k = 0; k < size; ++k) {
+      double phase = 2 * pi * static_cast<double>(k) / size;
+      palette.colours.push_back(pack_rgba8888(
+          Colour(0.5 + 0.5 * std::cos(phase),
+                 0.5 + 0.5 * std::cos(phase - 2 * pi / 3),
+                 0.5 + 0.5 * std::cos(phase + 2 * pi / 3))));
+   }
+   return palette;
+}
+
+Palette parse_palette(const std::string &name) {
+   if (name == "grey")
+      return grey_palette();
+   if (name == "rainbow")
+      return rainbow_palette();
+   throw std::runtime_error("Unknown palette: " + name);
+}
+
+std::future<void> submit_colouring(Thread_pool &pool,
+                                   const Escape_planes &escape,
+                                   const Palette &palette, uint32_t shift,
+                                   uint8_t *pixels, size_t pitch,
+                                   size_t step) {
+   Escape_planes source = escape;
+   if (palette.smooth) {
+      auto shared = std::make_shared<Palette>(palette);
+      return submit_tiles(
+          pool, pixels, escape.width, escape.height, pitch,
+          [source, shared, shift, step](const Tile &tile, const double *,
+                                        const double *, uint32_t *out,
+                                        size_t stride) {
+             for (size_t i = 0; i < tile.height; ++i) {
+                size_t y = tile.y + i;
+                size_t offset = (y - y % step) * source.width + tile.x;
+                const uint32_t *iterations = source.iterations + offset;
+                const float *norms = source.norms + offset;
+                uint32_t *row = out + i * stride;
+                for (size_t j = 0; j < tile.width; ++j) {
+                   size_t k = j - (tile.x + j) % step;
+                   row[j] = shared->colour(iterations[k], norms[k], shift);
+                }
+             }
+          },
+          colouring_tile_size);
+   }
+   auto table = std::make_shared<std::vector<uint32_t>>(
+       palette.unroll(escape.max_iter, shift));
+   uint32_t inside = palette.inside;
+   uint32_t max_iter = escape.max_iter;
+   return submit_tiles(
+       pool, pixels, escape.width, escape.height, pitch,
+       [source, table, inside, step, max_iter](const Tile &tile,
+                                               const double *,
+                                               const double *, uint32_t *out,
+                                               size_t stride) {
+          const uint32_t *colours = table->data();
+          // Planes mapped from a file may hold counts past max_iter.
+          auto colour = [colours, inside, max_iter](uint32_t iterations,
+                                                    float norm) {
+             return norm > 4.0f ? colours[std::min(iterations, max_iter)]
+                                : inside;
+          };
+          for (size_t i = 0; i < tile.height; ++i) {
+             size_t y = tile.y + i;
+             size_t offset = (y - y % step) * source.width + tile.x;
+             const uint32_t *iterations = source.iterations + offset;
+             const float *norms = source.norms + offset;
+             uint32_t *row = out + i * stride;
+             if (step == 1) {
+                for (size_t j = 0; j < tile.width; ++j)
+                   row[j] = colour(iterations[j], norms[j]);
+                continue;
+             }
+             for (size_t j = 0; j < tile.width; ++j) {
+                size_t k = j - (tile.x + j) % step;
+                row[j] = colour(iterations[k], norms[k]);
+             }
+          }
+       },
+       colouring_tile_size);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "escape_buffer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+// A lookup table from escape counts to pixels packed by pack_rgba8888().
+struct Palette {
+   // The colour for each escape count. Counts past the end take the last
+   // entry, or wrap around if the palette is cyclic.
+   std::vector<uint32_t> colours;
+   bool cyclic;
+   // The colour of points that never escaped.
+   uint32_t inside;
+   // Blend neighbouring entries by smooth_iterations() instead of banding by
+   // whole counts.
+   bool smooth = false;
+   // The degree of the formula coloured, which sets how smooth colouring
+   // divides up each iteration.
+   int degree = 2;
+   // If positive, escaped points whose distance estimate puts them within
+   // this many pixels of the set fade towards inside, drawing filaments
+   // thinner than a pixel at one sample per pixel; see shade().
+   double boundary = 0;
+
+   // The colour of a point, with its escape count advanced by shift, which
+   // rotates a cyclic palette through the image.
+   uint32_t colour(uint32_t iterations, float norm, uint32_t shift = 0) const {
+      if (!(norm > 4.0f))
+         return inside;
+      if (!smooth)
+         return entry(static_cast<size_t>(iterations) + shift);
+      // Not negative, since smooth_iterations() is not, so the cast below
+      // is safe.
+      double count = smooth_iterations(iterations, norm, degree) + shift;
+      double whole = std::floor(count);
+      auto k = static_cast<size_t>(whole);
+      return blend(entry(k), entry(k + 1), count - whole);
+   }
+
+   // colour, of an escaped point distance pixels from the set, with boundary
+   // shading applied.
+   uint32_t shade(uint32_t colour, double distance) const {
+      if (!(boundary > 0) || distance >= boundary)
+         return colour;
+      return blend(inside, colour, distance / boundary);
+   }
+
+   // colour() for escaped points with every count up to max_iter, as one
+   // table that needs neither clamping nor wrapping. Smooth palettes cannot
+   // be tabulated by count and must use colour().
+   std::vector<uint32_t> unroll(uint32_t max_iter, uint32_t shift) const {
+      std::vector<uint32_t> table(static_cast<size_t>(max_iter) + 1);
+      for (uint32_t i = 0; i <= max_iter; ++i)
+         table[i] = colour(i, 5.0f, shift);
+      return table;
+   }
+
+ private:
+   uint32_t entry(size_t k) const {
+      return colours[cyclic ? k % colours.size()
+                            : std::min(k, colours.size() - 1)];
+   }
+
+   // a, moved towards b by fraction t in each channel, to within 1/256.
+   static uint32_t blend(uint32_t a, uint32_t b, double t) {
+      auto weight = static_cast<uint32_t>(t * 256.0 + 0.5);
+      uint32_t result = 0;
+      for (int shift = 0; shift < 32; shift += 8) {
+         uint32_t from = (a >> shift) & 0xff;
+         uint32_t to = (b >> shift) & 0xff;
+         result |= ((from * (256 - weight) + to * weight + 128) >> 8) << shift;
+      }
+      return result;
+   }
+};
+
+// Escaped points run from black to white over the first 200 iterations.
+Palette grey_palette();
+
+// A smooth cycle of hues, repeating every 256 iterations.
+Palette rainbow_palette();
+
+// Accepts "grey" and "rainbow".
+Palette parse_palette(const std::string &name);
+
+// Starts colouring escape into an RGBA8888 image of the same size. Its
+// planes and pixels must stay valid until the future is ready. With a step
+// above one, only pixels whose coordinates are multiples of step are read,
+// each filling the step x step block below and to the right of it; this
+// shows a partly finished progressive render. Counts past escape.max_iter,
+// as a damaged escape file may hold, are coloured as max_iter. Boundary
+// shading needs distance estimates, which escape buffers do not keep, and
+// is ignored.
+std::future<void> submit_colouring(Thread_pool &pool,
+                                   const Escape_planes &escape,
+                                   const Palette &palette, uint32_t shift,
+                                   uint8_t *pixels, size_t pitch,
+                                   size_t step = 1);
@@ -0,0 +1,149 @@
+#include "perturbation.h"
+#include "render.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// The series is trusted while its cubic term stays this small relative to
+// its linear term for the furthest pixel.
+constexpr double series_tolerance = 1e-12;
+
+// How many times glitched pixels may be re-rendered from a new reference.
+constexpr int max_references = 16;
+
+constexpr size_t glitch_batch = 1024;
+
+} // namespace
+
+Reference_orbit compute_reference_orbit(Double_double c_re,
+                                        Double_double c_im, int max_iter) {
+   Reference_orbit orbit;
+   orbit.c_re = c_re;
+   orbit.c_im = c_im;
+   Double_double zr, zi;
+   for (int n = 0;; ++n) {
+      double r = static_cast<double>(zr);
+      double i = static_cast<double>(zi);
+      orbit.re.push_back(r);
+      orbit.im.push_back(i);
+      if (n == max_iter || r * r + i * i > 4.0)
+         break;
+      Double_double zri = zr * zi;
+      zr = zr * zr - zi * zi + c_re;
+      zi = zri + zri + c_im;
+   }
+   return orbit;
+}
+
+Series_approximation approximate_series(const Reference_orbit &orbit,
+                                        double max_offset, int max_iter) {
+   using Complex = std::complex<double>;
+   Series_approximation series{0, 0.0, 0.0, 0.0};
+   Complex a = 0.0, b = 0.0, c = 0.0;
+   double d = max_offset;
+   // The last orbit entry may already have escaped, so stop before it.
+   size_t limit = std::min(orbit.re.size() - 1, static_cast<size_t>(max_iter));
+   for (size_t n = 0; n + 1 < limit; ++n) {
+      Complex z(orbit.re[n], orbit.im[n]);
+      Complex next_a = 2.0 * z * a + 1.0;
+      Complex next_b = 2.0 * z * b + a * a;
+      Complex next_c = 2.0 * z * c + 2.0 * a * b;
+      a = next_a;
+      b = next_b;
+      c = next_c;
+
+      double linear = std::abs(a) * d;
+      double delta = linear + std::abs(b) * d * d + std::abs(c) * d * d * d;
+      Complex next_z(orbit.re[n + 1], orbit.im[n + 1]);
+      // Stop once the cubic term matters, or once a pixel might escape
+      // within the iterations being skipped.
+      if (!(std::abs(c) * d * d * d <= series_tolerance * linear) ||
+          !(std::abs(next_z) + delta < 2.0))
+         break;
+      series = {static_cast<int>(n + 1), a, b, c};
+   }
+   return series;
+}
+
+void render_perturbed(Thread_pool &pool, const Viewport &viewport,
+                      int max_iter, size_t width, size_t height,
+                      int *iterations, double *norms) {
+   std::vector<double> offsets_re(width);
+   std::vector<double> offsets_im(height);
+   for (size_t j = 0; j < width; ++j)
+      offsets_re[j] = offset_re(viewport, static_cast<double>(j) /
+                                              static_cast<double>(width));
+   for (size_t i = 0; i < height; ++i)
+      offsets_im[i] = offset_im(viewport, static_cast<double>(i) /
+                                              static_cast<double>(height));
+   std::vector<uint8_t> glitched(width * height);
+
+   Reference_orbit orbit = compute_reference_orbit(
+       viewport.centre_re, viewport.centre_im, max_iter);
+   Series_approximation series = approximate_series(
+       orbit, std::hypot(viewport.half_width, viewport.half_height),
+       max_iter);
+   Perturbation perturbation{orbit.re.data(), orbit.im.data(),
+                             orbit.re.size(), series.start,
+                             series.a,        series.b,
+                             series.c,        max_iter};
+
+   std::vector<Tile> tiles = make_tiles(width, height, default_tile_size);
+   pool.run(tiles.size(), [&](size_t index, size_t) {
+      const Tile &tile = tiles[index];
+      std::vector<double> dc_im(tile.width);
+      for (size_t i = tile.y; i < tile.y + tile.height; ++i) {
+         std::fill(dc_im.begin(), dc_im.end(), offsets_im[i]);
+         size_t offset = i * width + tile.x;
+         perturbed_escape_time(perturbation, offsets_re.data() + tile.x,
+                               dc_im.data(), tile.width, iterations + offset,
+                               norms + offset, glitched.data() + offset);
+      }
+   });
+
+   for (int reference = 0; reference < max_references; ++reference) {
+      std::vector<size_t> pending;
+      for (size_t k = 0; k < width * height; ++k)
+         if (glitched[k])
+            pending.push_back(k);
+      if (pending.empty())
+         break;
+
+      // A glitched pixel with the smallest |z| lies nearest the centre of
+      // its glitch, and makes the best new reference for it.
+      size_t best = *std::min_element(
+          pending.begin(), pending.end(),
+          [norms](size_t a, size_t b) { return norms[a] < norms[b]; });
+      double ref_re = offsets_re[best % width];
+      double ref_im = offsets_im[best / width];
+      orbit = compute_reference_orbit(viewport.centre_re + ref_re,
+                                      viewport.centre_im + ref_im, max_iter);
+      perturbation = {orbit.re.data(), orbit.im.data(), orbit.re.size(), 0,
+                      0.0, 0.0, 0.0, max_iter};
+
+      size_t batches = (pending.size() + glitch_batch - 1) / glitch_batch;
+      pool.run(batches, [&](size_t batch, size_t) {
+         size_t begin = batch * glitch_batch;
+         size_t count = std::min(glitch_batch, pending.size() - begin);
+         std::vector<double> dc_re(count), dc_im(count), batch_norms(count);
+         std::vector<int> batch_iterations(count);
+         std::vector<uint8_t> batch_glitched(count);
+         for (size_t k = 0; k < count; ++k) {
+            size_t pixel = pending[begin + k];
+            dc_re[k] = offsets_re[pixel % width] - ref_re;
+            dc_im[k] = offsets_im[pixel / width] - ref_im;
+         }
+         perturbed_escape_time(perturbation, dc_re.data(), dc_im.data(),
+                               count, batch_iterations.data(),
+                               batch_norms.data(), batch_glitched.data());
+         for (size_t k = 0; k < count; ++k) {
+            size_t pixel = pending[begin + k];
+            iterations[pixel] = batch_iterations[k];
+            norms[pixel] = batch_norms[k];
+            glitched[pixel] = batch_glitched[k];
+         }
+      });
+   }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "double_double.h"
+#include "escape_time.h"
+#include "thread_pool.h"
+#include "viewport.h"
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+// Deep zooms into the Mandelbrot set by perturbation. One reference orbit
+// Z_n is iterated in double-double precision, and every pixel c = C + dc is
+// iterated only as its offset delta_n = z_n - Z_n, which stays small enough
+// for double precision long after c itself cannot be told apart from its
+// neighbours.
+
+struct Reference_orbit {
+   Double_double c_re;
+   Double_double c_im;
+   // Z_n rounded to double, from Z_0 = 0 until the orbit escapes or reaches
+   // max_iter.
+   std::vector<double> re;
+   std::vector<double> im;
+};
+
+Reference_orbit compute_reference_orbit(Double_double c_re,
+                                        Double_double c_im, int max_iter);
+
+struct Series_approximation {
+   int start;
+   std::complex<double> a;
+   std::complex<double> b;
+   std::complex<double> c;
+};
+
+// Finds how many iterations can be skipped for every pixel within
+// max_offset of the reference by approximating delta_n with a cubic in dc.
+Series_approximation approximate_series(const Reference_orbit &orbit,
+                                        double max_offset, int max_iter);
+
+// Renders the Mandelbrot set over the viewport into width x height buffers
+// laid out as iterations[i * width + j]. Pixels flagged as glitched are
+// re-rendered from a new reference orbit placed among them, up to a fixed
+// number of times.
+void render_perturbed(Thread_pool &pool, const Viewport &viewport,
+                      int max_iter, size_t width, size_t height,
+                      int *iterations, double *norms);
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "thread_pool.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+template <typename Float_type, typename Int_type>
+Float_type NormalizeInt(Int_type int_value) {
+   return static_cast<Float_type>(int_value) *
+          (1.0 / static_cast<Float_type>(std::numeric_limits<Int_type>::max()));
+}
+
+template <typename Int_type, typename Float_type>
+Int_type DenormalizeInt(Float_type float_value) {
+   return static_cast<Int_type>(
+       float_value *
+       static_cast<Float_type>(std::numeric_limits<Int_type>::max()));
+}
+
+struct Colour {
+   uint8_t red;
+   uint8_t green;
+   uint8_t blue;
+
+   Colour() : red(0), green(0), blue(0) {}
+
+   Colour(uint8_t r, uint8_t g, uint8_t b) : red(r), green(g), blue(b) {}
+
+   Colour(double r, double g, double b)
+       : red(DenormalizeInt<uint8_t>(r)), green(DenormalizeInt<uint8_t>(g)),
+         blue(DenormalizeInt<uint8_t>(b)) {}
+};
+
+// Packs a pixel as SDL_PIXELFORMAT_RGBA8888, which stores each pixel as one
+// native-endian 32-bit value with red in the most significant byte.
+inline uint32_t pack_rgba8888(uint8_t red, uint8_t green, uint8_t blue,
+                              uint8_t alpha = 255) {
+   return (static_cast<uint32_t>(red) << 24) |
+          (static_cast<uint32_t>(green) << 16) |
+          (static_cast<uint32_t>(blue) << 8) | static_cast<uint32_t>(alpha);
+}
+
+inline uint32_t pack_rgba8888(const Colour &c) {
+   return pack_rgba8888(c.red, c.green, c.blue);
+}
+
+struct Tile {
+   size_t x;
+   size_t y;
+   size_t width;
+   size_t height;
+};
+
+static constexpr size_t default_tile_size = 64;
+
+inline std::vector<Tile> make_tiles(size_t width, size_t height,
+                                    size_t tile_size) {
+   std::vector<Tile> tiles;
+   for (size_t y = 0; y < height; y += tile_size)
+      for (size_t x = 0; x < width; x += tile_size)
+         tiles.push_back({x, y, std::min(tile_size, width - x),
+                          std::min(tile_size, height - y)});
+   return tiles;
+}
+
+// As submit_tiles(), but renders only rows [first_row, first_row + rows) of
+// the width x height image, into a buffer holding just those rows. f sees
+// the coordinates of the whole image, so bands put together match one
+// render of the image, and tiles relative to the band.
+template <typename Func>
+std::future<void> submit_band(Thread_pool &pool, uint8_t *buffer,
+                              size_t width, size_t height, size_t first_row,
+                              size_t rows, size_t pitch, Func f,
+                              size_t tile_size = default_tile_size) {
+   struct Job {
+      std::vector<double> xs;
+      std::vector<double> ys;
+      std::vector<Tile> tiles;
+      Func f;
+   };
+   auto job = std::make_shared<Job>(
+       Job{std::vector<double>(width), std::vector<double>(rows),
+           make_tiles(width, rows, tile_size), std::move(f)});
+   for (size_t j = 0; j < width; ++j)
+      job->xs[j] = static_cast<double>(j) / static_cast<double>(width);
+   for (size_t i = 0; i < rows; ++i)
+      job->ys[i] =
+          static_cast<double>(first_row + i) / static_cast<double>(height);
+
+   size_t stride = pitch / sizeof(uint32_t);
+   uint32_t *pixels = reinterpret_cast<uint32_t *>(buffer);
+   return pool.submit(job->tiles.size(),
+                      [job, pixels, stride, first_row](size_t index, size_t) {
+                         const Tile &tile = job->tiles[index];
+                         Trace_scope scope("tile", tile.x, first_row + tile.y);
+                         job->f(tile, job->xs.data() + tile.x,
+                                job->ys.data() + tile.y,
+                                pixels + tile.y * stride + tile.x, stride);
+                      });
+}
+
+// Starts rendering an RGBA8888 image one tile at a time on the pool, and
+// returns a future that becomes ready once every tile is done. For each
+// tile, f(tile, x, y, out, stride) is given the normalised coordinates of the
+// tile's columns (x[0..tile.width)) and rows (y[0..tile.height)), and fills
+// the tile's pixels, where pixel (j, i) of the tile is out[i * stride + j].
+// The coordinates are computed once per image, not once per pixel. f is
+// kept until the render finishes; buffer must stay valid until then.
+template <typename Func>
+std::future<void> submit_tiles(Thread_pool &pool, uint8_t *buffer,
+                               size_t width, size_t height, size_t pitch,
+                               Func f, size_t tile_size = default_tile_size) {
+   return submit_band(pool, buffer, width, height, 0, height, pitch,
+                      std::move(f), tile_size);
+}
+
+// As submit_tiles(), but waits for the image to be finished.
+template <typename Func>
+void generate_tiles(Thread_pool &pool, uint8_t *buffer, size_t width,
+                    size_t height, size_t pitch, Func f,
+                    size_t tile_size = default_tile_size) {
+   submit_tiles(pool, buffer, width, height, pitch, std::move(f), tile_size)
+       .get();
+}
+
+// Zeroes an image with the split of tiles among workers that submit_tiles()
+// uses. Memory is placed on the NUMA node of the thread that first touches
+// it, so a freshly allocated buffer touched this way has most of each
+// node's rows on that node, next to the workers that will render them. Like
+// any batch, the touching is open to stealing, so a node that finishes
+// early places some of another's rows; this is a hint, not a guarantee.
+inline void first_touch(Thread_pool &pool, uint8_t *buffer, size_t width,
+                        size_t height, size_t pitch,
+                        size_t tile_size = default_tile_size) {
+   generate_tiles(pool, buffer, width, height, pitch,
+                  [](const Tile &tile, const double *, const double *,
+                     uint32_t *out, size_t stride) {
+                     for (size_t i = 0; i < tile.height; ++i)
+                        std::fill_n(out + i * stride, tile.width, 0u);
+                  },
+                  tile_size);
+}
+
+// Renders an image by calling f(x, y) for the normalised coordinates of every
+// pixel.
+template <typename Func>
+void generate_pixels(Thread_pool &pool, uint8_t *buffer, size_t width,
+                     size_t height, size_t pitch, Func f,
+                     size_t tile_size = default_tile_size) {
+   generate_tiles(pool, buffer, width, height, pitch,
+                  [&f](const Tile &tile, const double *x, const double *y,
+                       uint32_t *out, size_t stride) {
+                     for (size_t i = 0; i < tile.height; ++i)
+                        for (size_t j = 0; j < tile.width; ++j)
+                           out[i * stride + j] = pack_rgba8888(f(x[j], y[i]));
+                  },
+                  tile_size);
+}
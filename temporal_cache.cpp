@@ -0,0 +1,85 @@
+#include "temporal_cache.h"
+
+#include <algorithm>
+
+namespace {
+
+// A tile is reused once this many renders in a row have each changed no
+// more than one escape count in changed_fraction of its pixels.
+constexpr unsigned stable_renders = 2;
+constexpr size_t changed_fraction = 256;
+
+} // namespace
+
+Temporal_cache::Temporal_cache(size_t width, size_t height, size_t tile_size,
+                               unsigned refresh_interval)
+    : width_(width), height_(height), tile_size_(tile_size),
+      columns_((width + tile_size - 1) / tile_size),
+      refresh_(refresh_interval) {
+   size_t rows = (height + tile_size - 1) / tile_size;
+   for (size_t k = 0; k < columns_ * rows; ++k)
+      entries_.emplace_back(new Entry);
+}
+
+void Temporal_cache::tile(const Fractal &fractal,
+                          const Render_settings &settings, uint64_t frame,
+                          const Tile &tile, const double *x, const double *y,
+                          uint32_t *out, size_t stride,
+                          Escape_summary *summary) {
+   Entry &entry =
+       *entries_[tile.y / tile_size_ * columns_ + tile.x / tile_size_];
+   {
+      std::lock_guard<std::mutex> lock(entry.mutex);
+      if (entry.valid && entry.stable >= stable_renders &&
+          entry.reused + 1 < refresh_) {
+         ++entry.reused;
+         for (size_t i = 0; i < tile.height; ++i)
+            std::copy_n(entry.pixels.data() + i * tile.width, tile.width,
+                        out + i * stride);
+         if (summary != nullptr)
+            summary->record(entry.highest);
+         reused_.fetch_add(1, std::memory_order_relaxed);
+         return;
+      }
+   }
+
+   // Rendered without the lock, so that the same tile of the next frame
+   // can be reused meanwhile.
+   std::vector<int> iterations(tile.width * tile.height);
+   Escape_summary own;
+   fractal_tile(fractal, settings, tile, x, y, out, stride, &own,
+                iterations.data());
+   if (summary != nullptr)
+      summary->record(own.highest());
+   rendered_.fetch_add(1, std::memory_order_relaxed);
+
+   std::lock_guard<std::mutex> lock(entry.mutex);
+   // A later frame's render of the tile may have finished first.
+   if (entry.valid && entry.frame > frame)
+      return;
+   size_t changed = iterations.size();
+   if (entry.valid && entry.iterations.size() == iterations.size()) {
+      changed = 0;
+      for (size_t k = 0; k < iterations.size(); ++k)
+         changed += iterations[k] != entry.iterations[k];
+   }
+   entry.stable =
+       changed * changed_fraction <= iterations.size() ? entry.stable + 1 : 0;
+   entry.reused = 0;
+   entry.valid = true;
+   entry.frame = frame;
+   entry.highest = own.highest();
+   entry.iterations.swap(iterations);
+   entry.pixels.resize(tile.width * tile.height);
+   for (size_t i = 0; i < tile.height; ++i)
+      std::copy_n(out + i * stride, tile.width,
+                  entry.pixels.data() + i * tile.width);
+}
+
+size_t Temporal_cache::reused() const {
+   return reused_.load(std::memory_order_relaxed);
+}
+
+size_t Temporal_cache::rendered() const {
+   return rendered_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "escape_time.h"
+#include "frame.h"
+#include "iteration_budget.h"
+#include "render.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// The tiles of recent frames of an animation whose parameter moves a little
+// each frame, such as the Julia set's c. Far from the set most of a frame
+// escapes in the same few iterations from one frame to the next; a tile
+// whose escape counts have stopped changing is shown from its last render
+// and rendered again only every refresh_interval frames, while tiles near
+// the set are rendered every frame as before.
+class Temporal_cache {
+ public:
+   // For frames of width x height pixels split into tiles of tile_size.
+   Temporal_cache(size_t width, size_t height, size_t tile_size,
+                  unsigned refresh_interval);
+
+   size_t width() const { return width_; }
+   size_t height() const { return height_; }
+
+   // A tile function for submit_tiles(), as fractal_tile() with summary,
+   // for tile of frame number frame. A tile reused from an earlier frame
+   // still records that frame's highest escape count in summary, so that
+   // an Iteration_budget fed from it follows the whole frame. May run for
+   // several frames at once on any threads; frames should be numbered in
+   // the order they are started.
+   void tile(const Fractal &fractal, const Render_settings &settings,
+             uint64_t frame, const Tile &tile, const double *x,
+             const double *y, uint32_t *out, size_t stride,
+             Escape_summary *summary);
+
+   // Tiles reused and rendered so far.
+   size_t reused() const;
+   size_t rendered() const;
+
+ private:
+   struct Entry {
+      std::mutex mutex;
+      bool valid = false;
+      uint64_t frame = 0;
+      std::vector<uint32_t> pixels;
+      std::vector<int> iterations;
+      int highest = 0;
+      // Renders in a row that changed next to no escape counts, and frames
+      // shown from the last render since.
+      unsigned stable = 0;
+      unsigned reused = 0;
+   };
+
+   size_t width_;
+   size_t height_;
+   size_t tile_size_;
+   size_t columns_;
+   unsigned refresh_;
+   std::vector<std::unique_ptr<Entry>> entries_;
+   std::atomic<size_t> reused_{0};
+   std::atomic<size_t> rendered_{0};
+};
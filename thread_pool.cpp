@@ -0,0 +1,178 @@
+#include "thread_pool.h"
+
+#include "cpu_topology.h"
+
+#include <stdexcept>
+#include <string>
+
+constexpr size_t Thread_pool::max_threads;
+
+Thread_pool::Thread_pool(size_t num_threads, Thread_placement placement) {
+   if (num_threads == 0)
+      num_threads = 1;
+   if (num_threads > max_threads)
+      throw std::runtime_error("At most " + std::to_string(max_threads) +
+                               " threads are supported");
+   workers_.reserve(num_threads);
+   for (size_t i = 0; i < num_threads; ++i)
+      workers_.emplace_back(new Worker);
+
+   // The CPU of each pinned worker. Node n gets the workers from
+   // num_threads * (CPUs before n) / total up to the next node's first.
+   std::vector<int> cpus;
+   std::vector<std::vector<int>> topology;
+   if (placement == Thread_placement::pinned)
+      topology = numa_cpus();
+   size_t total = 0;
+   for (const auto &node : topology)
+      total += node.size();
+   if (total != 0) {
+      nodes_ = topology.size();
+      size_t before = 0;
+      for (size_t n = 0; n < topology.size(); ++n) {
+         size_t first = num_threads * before / total;
+         before += topology[n].size();
+         size_t end = num_threads * before / total;
+         for (size_t i = first; i < end; ++i) {
+            workers_[i]->node = n;
+            cpus.push_back(topology[n][(i - first) % topology[n].size()]);
+         }
+      }
+   }
+
+   for (size_t i = 0; i < num_threads; ++i) {
+      Worker &self = *workers_[i];
+      for (size_t k = 1; k < num_threads; ++k)
+         if (workers_[(i + k) % num_threads]->node == self.node)
+            self.victims.push_back((i + k) % num_threads);
+      for (size_t k = 1; k < num_threads; ++k)
+         if (workers_[(i + k) % num_threads]->node != self.node)
+            self.victims.push_back((i + k) % num_threads);
+   }
+   for (size_t i = 0; i < num_threads; ++i) {
+      workers_[i]->thread = std::thread(&Thread_pool::worker_loop, this, i);
+      if (!cpus.empty())
+         pin_thread(workers_[i]->thread, cpus[i]);
+   }
+}
+
+Thread_pool::~Thread_pool() {
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+   }
+   wake_.notify_all();
+   for (auto &worker : workers_)
+      worker->thread.join();
+}
+
+size_t Thread_pool::default_num_threads() {
+   size_t n = std::thread::hardware_concurrency();
+   return n == 0 ? 1 : n;
+}
+
+std::future<void> Thread_pool::submit(size_t count, Task task) {
+   if (count == 0) {
+      std::promise<void> done;
+      done.set_value();
+      return done.get_future();
+   }
+
+   auto batch = std::make_shared<Batch>();
+   batch->task = std::move(task);
+   batch->remaining = count;
+   auto future = batch->done.get_future();
+
+   // Count the tasks before publishing them so that a worker can never claim
+   // one and decrement the counter below zero.
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queued_ += count;
+   }
+   size_t num_workers = workers_.size();
+   for (size_t w = 0; w < num_workers; ++w) {
+      size_t begin = w * count / num_workers;
+      size_t end = (w + 1) * count / num_workers;
+      if (begin == end)
+         continue;
+      std::lock_guard<std::mutex> lock(workers_[w]->mutex);
+      workers_[w]->ranges.push_back({batch, begin, end});
+   }
+   wake_.notify_all();
+   return future;
+}
+
+bool Thread_pool::pop_local(size_t worker, Range &task) {
+   Worker &self = *workers_[worker];
+   std::lock_guard<std::mutex> lock(self.mutex);
+   if (self.ranges.empty())
+      return false;
+   Range &front = self.ranges.front();
+   task = {front.batch, front.begin, front.begin + 1};
+   if (++front.begin == front.end)
+      self.ranges.pop_front();
+   --queued_;
+   return true;
+}
+
+bool Thread_pool::steal(size_t worker, Range &task) {
+   for (size_t v : workers_[worker]->victims) {
+      Worker &victim = *workers_[v];
+      Range stolen;
+      {
+         std::lock_guard<std::mutex> lock(victim.mutex);
+         if (victim.ranges.empty())
+            continue;
+         Range &back = victim.ranges.back();
+         size_t remaining = back.end - back.begin;
+         if (remaining > 1) {
+            size_t mid = back.begin + remaining / 2;
+            stolen = {back.batch, mid, back.end};
+            back.end = mid;
+         } else {
+            stolen = back;
+            victim.ranges.pop_back();
+         }
+         --queued_;
+      }
+      task = {stolen.batch, stolen.begin, stolen.begin + 1};
+      if (stolen.begin + 1 < stolen.end) {
+         Worker &self = *workers_[worker];
+         std::lock_guard<std::mutex> lock(self.mutex);
+         self.ranges.push_front({stolen.batch, stolen.begin + 1, stolen.end});
+      }
+      return true;
+   }
+   return false;
+}
+
+void Thread_pool::execute(const Range &task, size_t worker) {
+   Batch &batch = *task.batch;
+   try {
+      batch.task(task.begin, worker);
+   } catch (...) {
+      std::lock_guard<std::mutex> lock(batch.error_mutex);
+      if (!batch.error)
+         batch.error = std::current_exception();
+   }
+   if (--batch.remaining == 0) {
+      if (batch.error)
+         batch.done.set_exception(batch.error);
+      else
+         batch.done.set_value();
+   }
+}
+
+void Thread_pool::worker_loop(size_t worker) {
+   for (;;) {
+      Range task;
+      if (pop_local(worker, task) || steal(worker, task)) {
+         execute(task, worker);
+         continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+      if (stop_ && queued_ == 0)
+         return;
+   }
+}
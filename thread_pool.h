@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Where a pool's workers run. Pinned workers are spread over the NUMA nodes
+// in proportion to their CPUs, each fixed to one CPU, and numbered node by
+// node; placement falls back to floating where CPUs cannot be told apart.
+enum class Thread_placement { floating, pinned };
+
+// A fixed set of long-lived worker threads that execute batches of indexed
+// tasks. Each batch is split into one contiguous range per worker; a worker
+// that runs out of work steals half of another worker's remaining range, so
+// uneven task costs do not leave threads idle. Pinned workers steal from
+// their own node first and from another only when it has nothing left, and
+// since each node's workers hold consecutive ranges, the rows of a tiled
+// image written by one node stay together in memory.
+class Thread_pool {
+ public:
+   using Task = std::function<void(size_t index, size_t worker)>;
+
+   explicit Thread_pool(
+       size_t num_threads = default_num_threads(),
+       Thread_placement placement = Thread_placement::floating);
+   ~Thread_pool();
+
+   Thread_pool(const Thread_pool &) = delete;
+   Thread_pool &operator=(const Thread_pool &) = delete;
+
+   size_t size() const { return workers_.size(); }
+
+   // The NUMA node a worker is pinned to, counted from 0 over the nodes in
+   // use; always 0 for floating workers.
+   size_t node(size_t worker) const { return workers_[worker]->node; }
+   size_t nodes() const { return nodes_; }
+
+   // Runs task(i, worker) for every i in [0, count). The returned future
+   // becomes ready once every task has finished, and rethrows the first
+   // exception thrown by any of them.
+   std::future<void> submit(size_t count, Task task);
+
+   void run(size_t count, Task task) { submit(count, std::move(task)).get(); }
+
+   static size_t default_num_threads();
+
+   // More workers than this are taken for a mistake in the count.
+   static constexpr size_t max_threads = 1024;
+
+ private:
+   struct Batch {
+      Task task;
+      std::atomic<size_t> remaining;
+      std::promise<void> done;
+      std::mutex error_mutex;
+      std::exception_ptr error;
+   };
+
+   struct Range {
+      std::shared_ptr<Batch> batch;
+      size_t begin;
+      size_t end;
+   };
+
+   struct Worker {
+      std::mutex mutex;
+      std::deque<Range> ranges;
+      std::thread thread;
+      size_t node = 0;
+      // The other workers, in the order this one steals from them.
+      std::vector<size_t> victims;
+   };
+
+   bool pop_local(size_t worker, Range &task);
+   bool steal(size_t worker, Range &task);
+   void execute(const Range &task, size_t worker);
+   void worker_loop(size_t worker);
+
+   std::vector<std::unique_ptr<Worker>> workers_;
+   size_t nodes_ = 1;
+   std::atomic<size_t> queued_{0};
+   std::mutex mutex_;
+   std::condition_variable wake_;
+   bool stop_ = false;
+};
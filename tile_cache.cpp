@@ -0,0 +1,271 @@
+#include "tile_cache.h"
+#include "frame.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#ifdef FRACTALS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+// Stored tiles start with this, followed by the size of the uncompressed
+// planes and of the data that follows. Tiles are stored in native byte
+// order, for a cache shared by machines of the same architecture.
+constexpr char tile_magic[8] = {'F', 'R', 'T', 'I', 'L', 'E', '0', '1'};
+
+template <typename T>
+void hash_combine(size_t &seed, const T &value) {
+   seed ^= std::hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+uint64_t double_bits(double x) {
+   uint64_t bits;
+   std::memcpy(&bits, &x, sizeof(bits));
+   return bits;
+}
+
+std::vector<uint8_t> compress_bytes(const std::vector<uint8_t> &raw) {
+#ifdef FRACTALS_HAVE_ZLIB
+   uLongf size = compressBound(static_cast<uLong>(raw.size()));
+   std::vector<uint8_t> packed(size);
+   if (compress2(packed.data(), &size, raw.data(),
+                 static_cast<uLong>(raw.size()), Z_BEST_SPEED) != Z_OK)
+      return std::vector<uint8_t>();
+   packed.resize(size);
+   return packed;
+#else
+   return raw;
+#endif
+}
+
+bool decompress_bytes(const std::vector<uint8_t> &packed,
+                      std::vector<uint8_t> &raw) {
+#ifdef FRACTALS_HAVE_ZLIB
+   uLongf size = static_cast<uLongf>(raw.size());
+   return uncompress(raw.data(), &size, packed.data(),
+                     static_cast<uLong>(packed.size())) == Z_OK &&
+          size == raw.size();
+#else
+   if (packed.size() != raw.size())
+      return false;
+   raw = packed;
+   return true;
+#endif
+}
+
+// Differs for every call in the process and, with a random part drawn once,
+// almost surely between processes.
+std::string temporary_suffix() {
+   static const uint64_t process = [] {
+      std::random_device device;
+      return uint64_t(device()) << 32 | device();
+   }();
+   static std::atomic<uint64_t> next{0};
+   std::ostringstream suffix;
+   suffix << std::hex << process << '-' << next.fetch_add(1);
+   return suffix.str();
+}
+
+} // namespace
+
+std::vector<uint8_t> encode_tile(const Escape_buffer &tile) {
+   size_t plane = tile.width * tile.height;
+   std::vector<uint8_t> raw(plane * (sizeof(uint32_t) + sizeof(float)));
+   std::memcpy(raw.data(), tile.iterations.data(), plane * sizeof(uint32_t));
+   std::memcpy(raw.data() + plane * sizeof(uint32_t), tile.norms.data(),
+               plane * sizeof(float));
+   std::vector<uint8_t> packed = compress_bytes(raw);
+   if (packed.empty())
+      return packed;
+
+   uint64_t raw_size = raw.size(), packed_size = packed.size();
+   std::vector<uint8_t> encoded(sizeof(tile_magic) + 2 * sizeof(uint64_t));
+   std::memcpy(encoded.data(), tile_magic, sizeof(tile_magic));
+   std::memcpy(encoded.data() + sizeof(tile_magic), &raw_size,
+               sizeof(raw_size));
+   std::memcpy(encoded.data() + sizeof(tile_magic) + sizeof(raw_size),
+               &packed_size, sizeof(packed_size));
+   encoded.insert(encoded.end(), packed.begin(), packed.end());
+   return encoded;
+}
+
+bool decode_tile(const uint8_t *data, size_t size, Escape_buffer &tile) {
+   constexpr size_t header = sizeof(tile_magic) + 2 * sizeof(uint64_t);
+   uint64_t raw_size = 0, packed_size = 0;
+   if (size < header || std::memcmp(data, tile_magic, sizeof(tile_magic)) != 0)
+      return false;
+   std::memcpy(&raw_size, data + sizeof(tile_magic), sizeof(raw_size));
+   std::memcpy(&packed_size, data + sizeof(tile_magic) + sizeof(raw_size),
+               sizeof(packed_size));
+   size_t plane = tile.width * tile.height;
+   if (raw_size != plane * (sizeof(uint32_t) + sizeof(float)) ||
+       packed_size != size - header)
+      return false;
+
+   std::vector<uint8_t> packed(data + header, data + size), raw(raw_size);
+   if (!decompress_bytes(packed, raw))
+      return false;
+   std::memcpy(tile.iterations.data(), raw.data(), plane * sizeof(uint32_t));
+   std::memcpy(tile.norms.data(), raw.data() + plane * sizeof(uint32_t),
+               plane * sizeof(float));
+   // Colouring indexes a table of max_iter + 1 entries by these counts.
+   for (uint32_t count : tile.iterations)
+      if (count > tile.max_iter)
+         return false;
+   return true;
+}
+
+constexpr size_t Tile_cache::tile_pixels;
+
+bool operator==(const Tile_key &a, const Tile_key &b) {
+   return a.type == b.type && a.max_iter == b.max_iter &&
+          a.level == b.level && a.x == b.x && a.y == b.y &&
+          (a.type == Fractal_type::mandelbrot || a.c == b.c);
+}
+
+size_t Tile_key_hash::operator()(const Tile_key &key) const {
+   size_t seed = 0;
+   hash_combine(seed, static_cast<int>(key.type));
+   if (key.type == Fractal_type::julia) {
+      hash_combine(seed, key.c.real());
+      hash_combine(seed, key.c.imag());
+   }
+   hash_combine(seed, key.max_iter);
+   hash_combine(seed, key.level);
+   hash_combine(seed, key.x);
+   hash_combine(seed, key.y);
+   return seed;
+}
+
+Viewport tile_viewport(const Tile_key &key) {
+   double span = 4.0 / std::ldexp(1.0, static_cast<int>(key.level));
+   return {-2.0 + (static_cast<double>(key.x) + 0.5) * span,
+           -2.0 + (static_cast<double>(key.y) + 0.5) * span, span / 2,
+           span / 2};
+}
+
+Tile_cache::Tile_cache(Thread_pool &pool, size_t capacity,
+                       std::string directory)
+    : pool_(pool), capacity_(capacity), directory_(std::move(directory)) {}
+
+std::shared_ptr<const Escape_buffer> Tile_cache::get(const Tile_key &key) {
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto found = index_.find(key);
+      if (found != index_.end()) {
+         entries_.splice(entries_.begin(), entries_, found->second);
+         ++stats_.hits;
+         return found->second->second;
+      }
+   }
+
+   // Loading and rendering happen unlocked, so two threads missing the
+   // same tile may both render it; the first to finish is kept.
+   std::shared_ptr<const Escape_buffer> tile = load(key);
+   bool from_disk = tile != nullptr;
+   if (!from_disk) {
+      tile = render(key);
+      store(key, *tile);
+   }
+
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (from_disk)
+      ++stats_.disk_hits;
+   else
+      ++stats_.misses;
+   auto found = index_.find(key);
+   if (found != index_.end())
+      return found->second->second;
+   entries_.emplace_front(key, tile);
+   index_[key] = entries_.begin();
+   while (entries_.size() > capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+      ++stats_.evictions;
+   }
+   return tile;
+}
+
+Tile_cache_stats Tile_cache::stats() const {
+   std::lock_guard<std::mutex> lock(mutex_);
+   return stats_;
+}
+
+std::shared_ptr<const Escape_buffer> Tile_cache::render(const Tile_key &key) {
+   Viewport viewport = tile_viewport(key);
+   Render_settings settings{
+       Render_method::brute_force, viewport, key.max_iter,
+       choose_precision(viewport, tile_pixels, tile_pixels)};
+   Fractal fractal{key.type, key.c, key.max_iter};
+   auto tile = std::make_shared<Escape_buffer>(
+       tile_pixels, tile_pixels, static_cast<uint32_t>(key.max_iter));
+   render_escape(pool_, fractal, settings, *tile);
+   return tile;
+}
+
+std::string Tile_cache::path(const Tile_key &key) const {
+   char name[160];
+   if (key.type == Fractal_type::mandelbrot)
+      std::snprintf(name, sizeof(name), "/mandelbrot_i%d_z%u_x%llu_y%llu.tile",
+                    key.max_iter, key.level,
+                    static_cast<unsigned long long>(key.x),
+                    static_cast<unsigned long long>(key.y));
+   else
+      std::snprintf(name, sizeof(name),
+                    "/julia_%016llx_%016llx_i%d_z%u_x%llu_y%llu.tile",
+                    static_cast<unsigned long long>(double_bits(key.c.real())),
+                    static_cast<unsigned long long>(double_bits(key.c.imag())),
+                    key.max_iter, key.level,
+                    static_cast<unsigned long long>(key.x),
+                    static_cast<unsigned long long>(key.y));
+   return directory_ + name;
+}
+
+std::shared_ptr<const Escape_buffer>
+Tile_cache::load(const Tile_key &key) const {
+   if (directory_.empty())
+      return nullptr;
+   std::ifstream file(path(key), std::ios::binary);
+   std::vector<uint8_t> encoded((std::istreambuf_iterator<char>(file)),
+                                std::istreambuf_iterator<char>());
+   auto tile = std::make_shared<Escape_buffer>(
+       tile_pixels, tile_pixels, static_cast<uint32_t>(key.max_iter));
+   if (!file || !decode_tile(encoded.data(), encoded.size(), *tile))
+      return nullptr;
+   return tile;
+}
+
+void Tile_cache::store(const Tile_key &key, const Escape_buffer &tile) const {
+   if (directory_.empty())
+      return;
+   std::vector<uint8_t> encoded = encode_tile(tile);
+   if (encoded.empty())
+      return;
+
+   // Written under a temporary name and renamed into place, so that a
+   // concurrent reader never sees a partial tile. The name is unique to
+   // this write, since several threads, or processes sharing the
+   // directory, may store the same tile at once.
+   std::string final_path = path(key);
+   std::string temporary = final_path + "." + temporary_suffix() + ".tmp";
+   {
+      std::ofstream file(temporary, std::ios::binary);
+      file.write(reinterpret_cast<const char *>(encoded.data()),
+                 static_cast<std::streamsize>(encoded.size()));
+      if (!file) {
+         file.close();
+         std::remove(temporary.c_str());
+         return;
+      }
+   }
+   std::rename(temporary.c_str(), final_path.c_str());
+}
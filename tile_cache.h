@@ -0,0 +1,90 @@
+#pragma once
+
+#include "escape_buffer.h"
+#include "escape_time.h"
+#include "thread_pool.h"
+#include "viewport.h"
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// One tile of a fixed tiling of the square [-2, 2] x [-2, 2]: level n
+// splits it into 2^n x 2^n tiles, with tile (0, 0) at the top left.
+struct Tile_key {
+   Fractal_type type;
+   // The Julia constant; ignored for the Mandelbrot set.
+   std::complex<double> c;
+   int max_iter;
+   unsigned level;
+   uint64_t x;
+   uint64_t y;
+};
+
+bool operator==(const Tile_key &a, const Tile_key &b);
+
+struct Tile_key_hash {
+   size_t operator()(const Tile_key &key) const;
+};
+
+// The region of the plane covered by a tile.
+Viewport tile_viewport(const Tile_key &key);
+
+// A tile's escape times as the cache stores them on disk: a short header,
+// then both planes, compressed with zlib when it was found. Empty if
+// compression failed.
+std::vector<uint8_t> encode_tile(const Escape_buffer &tile);
+
+// Reads the result of encode_tile() into tile, whose size must already be
+// that of the encoded tile. False if the data are malformed or hold counts
+// past tile.max_iter, so that the tile is rendered again instead.
+bool decode_tile(const uint8_t *data, size_t size, Escape_buffer &tile);
+
+struct Tile_cache_stats {
+   uint64_t hits = 0;
+   uint64_t disk_hits = 0;
+   uint64_t misses = 0;
+   uint64_t evictions = 0;
+};
+
+// Escape times of tiles, rendered on demand and kept in memory, least
+// recently used first out. Given a directory, tiles are also stored there
+// compressed and loaded again by later caches; a tile that cannot be read
+// or written is simply rendered again. Safe to use from several threads,
+// but not from tasks running on the cache's own pool.
+class Tile_cache {
+ public:
+   static constexpr size_t tile_pixels = 256;
+
+   Tile_cache(Thread_pool &pool, size_t capacity,
+              std::string directory = std::string());
+
+   std::shared_ptr<const Escape_buffer> get(const Tile_key &key);
+
+   Tile_cache_stats stats() const;
+
+ private:
+   using Entry = std::pair<Tile_key, std::shared_ptr<const Escape_buffer>>;
+
+   std::shared_ptr<const Escape_buffer> render(const Tile_key &key);
+   std::string path(const Tile_key &key) const;
+   std::shared_ptr<const Escape_buffer> load(const Tile_key &key) const;
+   void store(const Tile_key &key, const Escape_buffer &tile) const;
+
+   Thread_pool &pool_;
+   size_t capacity_;
+   std::string directory_;
+   mutable std::mutex mutex_;
+   // Most recently used first.
+   std::list<Entry> entries_;
+   std::unordered_map<Tile_key, std::list<Entry>::iterator, Tile_key_hash>
+       index_;
+   Tile_cache_stats stats_;
+};
@@ -0,0 +1,547 @@
+#include "tile_network.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#ifdef FRACTALS_HAVE_SOCKETS
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr size_t tile_pixels = Tile_cache::tile_pixels;
+
+// The key of tile index of a block, counting along rows from first.
+Tile_key block_key(const Tile_key &first, size_t columns, size_t index) {
+   Tile_key key = first;
+   key.x += index % columns;
+   key.y += index / columns;
+   return key;
+}
+
+void place_tile(const Escape_buffer &tile, size_t index, size_t columns,
+                Escape_buffer &block) {
+   size_t x = index % columns * tile_pixels;
+   size_t y = index / columns * tile_pixels;
+   for (size_t i = 0; i < tile_pixels; ++i) {
+      size_t from = i * tile_pixels;
+      size_t to = (y + i) * block.width + x;
+      std::copy_n(tile.iterations.begin() + from, tile_pixels,
+                  block.iterations.begin() + to);
+      std::copy_n(tile.norms.begin() + from, tile_pixels,
+                  block.norms.begin() + to);
+   }
+}
+
+// The state of a block shared by the threads talking to workers.
+struct Block_progress {
+   std::mutex mutex;
+   std::condition_variable changed;
+   // Tiles not yet sent to any worker.
+   std::deque<size_t> unsent;
+   // How many workers are rendering each tile.
+   std::vector<unsigned> copies;
+   std::vector<bool> done;
+   size_t remaining = 0;
+   // Each worker's connection while it is open, else -1.
+   std::vector<int> sockets;
+};
+
+#ifdef FRACTALS_HAVE_SOCKETS
+
+constexpr size_t no_tile = ~size_t(0);
+
+// At most this many workers render the same tile at once.
+constexpr unsigned max_copies = 2;
+
+// The tile a worker should render next: an unsent one if there is any,
+// else the one outstanding on the fewest workers. no_tile if every tile is
+// done or already has max_copies workers. Call with the mutex held.
+size_t next_tile(Block_progress &progress) {
+   if (!progress.unsent.empty()) {
+      size_t index = progress.unsent.front();
+      progress.unsent.pop_front();
+      return index;
+   }
+   size_t best = no_tile;
+   for (size_t index = 0; index < progress.done.size(); ++index)
+      if (!progress.done[index] && progress.copies[index] < max_copies &&
+          (best == no_tile ||
+           progress.copies[index] < progress.copies[best]))
+         best = index;
+   return best;
+}
+
+// The fields of a Tile_key: type, c, max_iter, level, x and y.
+constexpr size_t request_size = 4 + 2 * 8 + 4 + 4 + 2 * 8;
+
+// At most this many coordinators are served at once, each on a thread of
+// its own.
+constexpr size_t max_connections = 64;
+
+// The connections a worker has open, shared with their threads.
+struct Connection_slots {
+   std::mutex mutex;
+   std::condition_variable freed;
+   size_t open = 0;
+
+   void release() {
+      std::lock_guard<std::mutex> lock(mutex);
+      --open;
+      freed.notify_one();
+   }
+};
+
+// Larger replies are taken as garbage; compression never doubles a tile.
+constexpr uint64_t largest_reply =
+    2 * tile_pixels * tile_pixels * (sizeof(uint32_t) + sizeof(float));
+
+// Closes the descriptor it owns.
+class Socket {
+ public:
+   explicit Socket(int fd = -1) : fd_(fd) {}
+   Socket(Socket &&other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
+   Socket &operator=(Socket &&other) noexcept {
+      std::swap(fd_, other.fd_);
+      return *this;
+   }
+   ~Socket() {
+      if (fd_ >= 0)
+         close(fd_);
+   }
+
+   Socket(const Socket &) = delete;
+   Socket &operator=(const Socket &) = delete;
+
+   int fd() const { return fd_; }
+
+ private:
+   int fd_;
+};
+
+using Clock = std::chrono::steady_clock;
+
+constexpr Clock::time_point no_deadline = Clock::time_point::max();
+
+// seconds from now, or no_deadline if that is too far off to represent.
+Clock::time_point deadline_after(double seconds) {
+   if (!(seconds < 1e9))
+      return no_deadline;
+   return Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                             std::chrono::duration<double>(seconds));
+}
+
+// Waits for fd to be ready for events, or to fail. False if deadline
+// passes first.
+bool wait_ready(int fd, short events, Clock::time_point deadline) {
+   for (;;) {
+      int wait = -1;
+      if (deadline != no_deadline) {
+         Clock::duration left = deadline - Clock::now();
+         if (left <= Clock::duration::zero())
+            return false;
+         // Rounded up, so as not to spin through the last millisecond.
+         auto milliseconds =
+             std::chrono::duration_cast<std::chrono::milliseconds>(left)
+                 .count() +
+             1;
+         wait = static_cast<int>(std::min<decltype(milliseconds)>(
+             milliseconds, INT_MAX));
+      }
+      pollfd entry{fd, events, 0};
+      int ready = poll(&entry, 1, wait);
+      if (ready < 0 && errno == EINTR)
+         continue;
+      return ready > 0;
+   }
+}
+
+bool would_block() {
+   return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+// Both give up once deadline passes, however the bytes are trickling in.
+bool send_all(int fd, const void *data, size_t size,
+              Clock::time_point deadline = no_deadline) {
+   auto bytes = static_cast<const char *>(data);
+   while (size > 0) {
+      if (!wait_ready(fd, POLLOUT, deadline))
+         return false;
+      ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (sent < 0 && would_block())
+         continue;
+      if (sent <= 0)
+         return false;
+      bytes += sent;
+      size -= static_cast<size_t>(sent);
+   }
+   return true;
+}
+
+bool receive_all(int fd, void *data, size_t size,
+                 Clock::time_point deadline = no_deadline) {
+   auto bytes = static_cast<char *>(data);
+   while (size > 0) {
+      if (!wait_ready(fd, POLLIN, deadline))
+         return false;
+      ssize_t received = recv(fd, bytes, size, MSG_DONTWAIT);
+      if (received < 0 && would_block())
+         continue;
+      if (received <= 0)
+         return false;
+      bytes += received;
+      size -= static_cast<size_t>(received);
+   }
+   return true;
+}
+
+template <typename T>
+uint8_t *put(uint8_t *out, T value) {
+   std::memcpy(out, &value, sizeof(value));
+   return out + sizeof(value);
+}
+
+template <typename T>
+const uint8_t *get(const uint8_t *in, T &value) {
+   std::memcpy(&value, in, sizeof(value));
+   return in + sizeof(value);
+}
+
+void encode_request(const Tile_key &key, uint8_t *out) {
+   out = put(out, static_cast<uint32_t>(key.type));
+   out = put(out, key.c.real());
+   out = put(out, key.c.imag());
+   out = put(out, static_cast<int32_t>(key.max_iter));
+   out = put(out, static_cast<uint32_t>(key.level));
+   out = put(out, static_cast<uint64_t>(key.x));
+   put(out, static_cast<uint64_t>(key.y));
+}
+
+bool decode_request(const uint8_t *in, Tile_key &key) {
+   uint32_t type, level;
+   double re, im;
+   int32_t max_iter;
+   uint64_t x, y;
+   in = get(in, type);
+   in = get(in, re);
+   in = get(in, im);
+   in = get(in, max_iter);
+   in = get(in, level);
+   in = get(in, x);
+   get(in, y);
+   if (type > static_cast<uint32_t>(Fractal_type::julia) || max_iter <= 0 ||
+       level >= 64 || x >> level != 0 || y >> level != 0 ||
+       !std::isfinite(re) || !std::isfinite(im))
+      return false;
+   key = {static_cast<Fractal_type>(type), {re, im}, max_iter, level, x, y};
+   return true;
+}
+
+void set_no_delay(int fd) {
+   int one = 1;
+   setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Connects fd to address, giving up once deadline passes. fd is left
+// non-blocking.
+bool connect_by(int fd, const addrinfo &address, Clock::time_point deadline) {
+   int flags = fcntl(fd, F_GETFL);
+   if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+      return false;
+   if (connect(fd, address.ai_addr, address.ai_addrlen) == 0)
+      return true;
+   if (errno != EINPROGRESS || !wait_ready(fd, POLLOUT, deadline))
+      return false;
+   int error = 0;
+   socklen_t length = sizeof(error);
+   return getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 &&
+          error == 0;
+}
+
+// A connection to address, HOST:PORT, or an invalid socket on failure or
+// after timeout seconds.
+Socket connect_to(const std::string &address, double timeout) {
+   size_t colon = address.rfind(':');
+   std::string host = address.substr(0, colon);
+   std::string port = address.substr(colon + 1);
+   addrinfo hints{};
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   addrinfo *found = nullptr;
+   Clock::time_point deadline = deadline_after(timeout);
+   if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0)
+      return Socket();
+   std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> list(found,
+                                                           &freeaddrinfo);
+   for (addrinfo *option = found; option != nullptr;
+        option = option->ai_next) {
+      Socket socket(::socket(option->ai_family, option->ai_socktype,
+                             option->ai_protocol));
+      if (socket.fd() < 0)
+         continue;
+      set_no_delay(socket.fd());
+      if (connect_by(socket.fd(), *option, deadline))
+         return socket;
+   }
+   return Socket();
+}
+
+// False if the whole exchange takes longer than timeout seconds.
+bool fetch_tile(int fd, const Tile_key &key, double timeout,
+                Escape_buffer &tile) {
+   Clock::time_point deadline = deadline_after(timeout);
+   uint8_t request[request_size];
+   encode_request(key, request);
+   uint64_t size = 0;
+   if (!send_all(fd, request, sizeof(request), deadline) ||
+       !receive_all(fd, &size, sizeof(size), deadline) || size == 0 ||
+       size > largest_reply)
+      return false;
+   std::vector<uint8_t> reply(size);
+   return receive_all(fd, reply.data(), reply.size(), deadline) &&
+          decode_tile(reply.data(), reply.size(), tile);
+}
+
+// Answers requests on one connection until it closes, sends garbage or
+// asks for more than max_iter iterations.
+void serve_connection(Tile_cache &cache, int max_iter, Socket socket) {
+   uint8_t request[request_size];
+   try {
+      while (receive_all(socket.fd(), request, sizeof(request))) {
+         Tile_key key;
+         if (!decode_request(request, key))
+            return;
+         if (key.max_iter > max_iter) {
+            std::cerr << "Refusing a tile of " << key.max_iter
+                      << " iterations, past --iterations " << max_iter
+                      << std::endl;
+            return;
+         }
+         // An empty reply, if compression failed, tells the coordinator to
+         // look elsewhere.
+         std::vector<uint8_t> reply = encode_tile(*cache.get(key));
+         uint64_t size = reply.size();
+         if (!send_all(socket.fd(), &size, sizeof(size)) ||
+             !send_all(socket.fd(), reply.data(), reply.size()))
+            return;
+      }
+   } catch (const std::exception &e) {
+      std::cerr << "Dropping a connection: " << e.what() << std::endl;
+   }
+}
+
+// Sends tiles of the block to the worker on socket until none are left or
+// the worker fails.
+void run_worker(int fd, double timeout, const Tile_key &first,
+                size_t columns, Block_progress &progress,
+                Escape_buffer &block, Worker_stats &stats) {
+   Escape_buffer tile(tile_pixels, tile_pixels,
+                      static_cast<uint32_t>(first.max_iter));
+   std::unique_lock<std::mutex> lock(progress.mutex);
+   for (;;) {
+      size_t index = no_tile;
+      while (progress.remaining != 0 &&
+             (index = next_tile(progress)) == no_tile)
+         progress.changed.wait(lock);
+      if (progress.remaining == 0)
+         return;
+      ++progress.copies[index];
+      lock.unlock();
+      bool fetched =
+          fetch_tile(fd, block_key(first, columns, index), timeout, tile);
+      lock.lock();
+      --progress.copies[index];
+      // The block may have been finished, and this connection shut down,
+      // while the tile was outstanding.
+      if (progress.remaining == 0)
+         return;
+      if (!fetched) {
+         stats.failed = true;
+         if (!progress.done[index] && progress.copies[index] == 0)
+            progress.unsent.push_front(index);
+         progress.changed.notify_all();
+         return;
+      }
+      if (!progress.done[index]) {
+         place_tile(tile, index, columns, block);
+         progress.done[index] = true;
+         ++stats.tiles;
+         // Other copies of the last tiles are abandoned, not awaited.
+         if (--progress.remaining == 0)
+            for (int socket : progress.sockets)
+               if (socket >= 0)
+                  shutdown(socket, SHUT_RDWR);
+         progress.changed.notify_all();
+      }
+   }
+}
+
+void connect_and_run(size_t worker, double timeout, const Tile_key &first,
+                     size_t columns, Block_progress &progress,
+                     Escape_buffer &block, Worker_stats &stats) {
+   Socket socket = connect_to(stats.address, timeout);
+   if (socket.fd() < 0) {
+      std::lock_guard<std::mutex> lock(progress.mutex);
+      stats.failed = true;
+      return;
+   }
+   {
+      std::lock_guard<std::mutex> lock(progress.mutex);
+      progress.sockets[worker] = socket.fd();
+   }
+   run_worker(socket.fd(), timeout, first, columns, progress, block, stats);
+   // Before the socket closes, so that it is never shut down once its
+   // descriptor may have been reused.
+   std::lock_guard<std::mutex> lock(progress.mutex);
+   progress.sockets[worker] = -1;
+}
+
+#endif
+
+} // namespace
+
+#ifdef FRACTALS_HAVE_SOCKETS
+
+void serve_tiles(Tile_cache &cache, const std::string &host, uint16_t port,
+                 int max_iter) {
+   std::string where = host + ":" + std::to_string(port);
+   addrinfo hints{};
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = AI_PASSIVE;
+   addrinfo *found = nullptr;
+   int status = getaddrinfo(host.c_str(), std::to_string(port).c_str(),
+                            &hints, &found);
+   if (status != 0)
+      throw std::runtime_error("Cannot listen on " + where + ": " +
+                               gai_strerror(status));
+   std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> list(found,
+                                                           &freeaddrinfo);
+   Socket listener;
+   int error = 0;
+   for (addrinfo *option = found; option != nullptr;
+        option = option->ai_next) {
+      Socket candidate(::socket(option->ai_family, option->ai_socktype,
+                                option->ai_protocol));
+      int one = 1;
+      if (candidate.fd() >= 0 &&
+          setsockopt(candidate.fd(), SOL_SOCKET, SO_REUSEADDR, &one,
+                     sizeof(one)) == 0 &&
+          bind(candidate.fd(), option->ai_addr, option->ai_addrlen) == 0 &&
+          listen(candidate.fd(), SOMAXCONN) == 0) {
+         listener = std::move(candidate);
+         break;
+      }
+      error = errno;
+   }
+   if (listener.fd() < 0)
+      throw std::runtime_error("Cannot listen on " + where + ": " +
+                               std::strerror(error));
+   std::cerr << "Serving tiles on " << where << std::endl;
+
+   // Connections past the limit wait in the listen queue for one to close.
+   auto slots = std::make_shared<Connection_slots>();
+   for (;;) {
+      {
+         std::unique_lock<std::mutex> lock(slots->mutex);
+         slots->freed.wait(lock,
+                           [&slots] { return slots->open < max_connections; });
+         ++slots->open;
+      }
+      int fd = accept(listener.fd(), nullptr, nullptr);
+      if (fd < 0) {
+         slots->release();
+         if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+         throw std::runtime_error(std::string("Cannot accept: ") +
+                                  std::strerror(errno));
+      }
+      set_no_delay(fd);
+      // Connections live as long as their coordinators keep them open; the
+      // server itself never returns.
+      std::thread(
+          [&cache, max_iter, slots](Socket socket) {
+             serve_connection(cache, max_iter, std::move(socket));
+             slots->release();
+          },
+          Socket(fd))
+          .detach();
+   }
+}
+
+#else
+
+void serve_tiles(Tile_cache &, const std::string &, uint16_t, int) {
+   throw std::runtime_error("Serving tiles needs POSIX sockets");
+}
+
+#endif
+
+Escape_buffer render_tile_block(Tile_cache &cache,
+                                const std::vector<std::string> &workers,
+                                const Tile_key &first, size_t columns,
+                                size_t rows, double timeout,
+                                std::vector<Worker_stats> *stats) {
+   if (columns == 0 || rows == 0)
+      throw std::runtime_error("A tile block needs at least one tile");
+   size_t tiles = columns * rows;
+   std::vector<Worker_stats> worker_stats(workers.size());
+   for (size_t w = 0; w < workers.size(); ++w) {
+      size_t colon = workers[w].rfind(':');
+      if (colon == std::string::npos || colon == 0 ||
+          colon + 1 == workers[w].size())
+         throw std::runtime_error("Expected HOST:PORT: " + workers[w]);
+      worker_stats[w].address = workers[w];
+   }
+
+   Escape_buffer block(columns * tile_pixels, rows * tile_pixels,
+                       static_cast<uint32_t>(first.max_iter));
+   Block_progress progress;
+   progress.copies.assign(tiles, 0);
+   progress.done.assign(tiles, false);
+   progress.remaining = tiles;
+   progress.sockets.assign(workers.size(), -1);
+   for (size_t index = 0; index < tiles; ++index)
+      progress.unsent.push_back(index);
+
+   if (!workers.empty()) {
+#ifdef FRACTALS_HAVE_SOCKETS
+      std::vector<std::thread> threads;
+      for (size_t w = 0; w < workers.size(); ++w)
+         threads.emplace_back(connect_and_run, w, timeout, std::cref(first),
+                              columns, std::ref(progress), std::ref(block),
+                              std::ref(worker_stats[w]));
+      for (std::thread &thread : threads)
+         thread.join();
+#else
+      throw std::runtime_error("Distributed rendering needs POSIX sockets");
+#endif
+   }
+
+   for (size_t index = 0; index < tiles; ++index)
+      if (!progress.done[index])
+         place_tile(*cache.get(block_key(first, columns, index)), index,
+                    columns, block);
+   if (stats != nullptr)
+      *stats = std::move(worker_stats);
+   return block;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "escape_buffer.h"
+#include "tile_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Rendering blocks of the fixed tiling on other machines over TCP. Each
+// request is one Tile_key, answered with the tile as encode_tile() stores
+// it. Both are sent in native byte order, so workers must share the
+// coordinator's architecture, as a shared tile cache must.
+
+// Answers tile requests on host:port, rendering through cache, until the
+// process is killed. There is no authentication, so host should be one only
+// trusted coordinators can reach. Requests for more than max_iter
+// iterations are refused, and a bounded number of coordinators is served at
+// once; others wait for a connection to close.
+void serve_tiles(Tile_cache &cache, const std::string &host, uint16_t port,
+                 int max_iter);
+
+struct Worker_stats {
+   // As given, host:port.
+   std::string address;
+   size_t tiles = 0;
+   // Whether the worker was dropped after an error or a timeout.
+   bool failed = false;
+};
+
+// The columns x rows tiles from first rightwards and downwards, in one
+// buffer, fetched from workers with one request at a time outstanding on
+// each. A worker that fails or takes longer than timeout seconds over a
+// tile is dropped and its tile sent to another; once every tile has been
+// sent, idle workers duplicate those still outstanding, so that one slow
+// worker cannot hold up the whole block. Tiles left when every worker has
+// been dropped, or all of them with no workers, are rendered through cache.
+// If stats is given, it receives one entry per worker.
+Escape_buffer render_tile_block(Tile_cache &cache,
+                                const std::vector<std::string> &workers,
+                                const Tile_key &first, size_t columns,
+                                size_t rows, double timeout,
+                                std::vector<Worker_stats> *stats = nullptr);
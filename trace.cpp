@@ -0,0 +1,159 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+// Beyond this many events a thread keeps counting its busy time but
+// records no more, so that a long session cannot exhaust memory.
+constexpr size_t max_events_per_thread = size_t(1) << 18;
+
+constexpr size_t no_event = ~size_t(0);
+
+struct Trace_event {
+   const char *name;
+   int64_t start_ns;
+   int64_t duration_ns;
+   // The tile's position, or -1 for stages.
+   int64_t x;
+   int64_t y;
+   uint64_t iterations;
+};
+
+std::atomic<bool> enabled{false};
+std::atomic<int64_t> origin_ns{0};
+
+int64_t now_ns() {
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now().time_since_epoch())
+       .count();
+}
+
+} // namespace
+
+struct Thread_trace {
+   size_t id;
+   std::vector<Trace_event> events;
+   // Indices of the events of the scopes open on this thread, innermost
+   // last.
+   std::vector<size_t> open;
+   // Written only by the owning thread, read by any.
+   std::atomic<int64_t> busy_ns{0};
+};
+
+namespace {
+
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<Thread_trace>> registry;
+thread_local Thread_trace *current = nullptr;
+
+Thread_trace *this_thread() {
+   if (current == nullptr) {
+      std::lock_guard<std::mutex> lock(registry_mutex);
+      registry.emplace_back(new Thread_trace);
+      current = registry.back().get();
+      current->id = registry.size() - 1;
+   }
+   return current;
+}
+
+} // namespace
+
+void enable_tracing() {
+   if (!enabled.exchange(true))
+      origin_ns.store(now_ns());
+}
+
+bool tracing_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+Trace_scope::Trace_scope(const char *name) {
+   if (tracing_enabled())
+      open(name, -1, -1);
+}
+
+Trace_scope::Trace_scope(const char *name, size_t x, size_t y) {
+   if (tracing_enabled())
+      open(name, static_cast<int64_t>(x), static_cast<int64_t>(y));
+}
+
+void Trace_scope::open(const char *name, int64_t x, int64_t y) {
+   thread_ = this_thread();
+   start_ = now_ns();
+   event_ = no_event;
+   if (thread_->events.size() < max_events_per_thread) {
+      event_ = thread_->events.size();
+      thread_->events.push_back({name, start_, 0, x, y, 0});
+   }
+   thread_->open.push_back(event_);
+   tile_ = x >= 0;
+}
+
+Trace_scope::~Trace_scope() {
+   if (thread_ == nullptr)
+      return;
+   int64_t duration = now_ns() - start_;
+   thread_->open.pop_back();
+   if (event_ != no_event)
+      thread_->events[event_].duration_ns = duration;
+   if (tile_)
+      thread_->busy_ns.store(
+          thread_->busy_ns.load(std::memory_order_relaxed) + duration,
+          std::memory_order_relaxed);
+}
+
+void trace_iterations(uint64_t count) {
+   Thread_trace *thread = current;
+   if (!tracing_enabled() || thread == nullptr || thread->open.empty() ||
+       thread->open.back() == no_event)
+      return;
+   thread->events[thread->open.back()].iterations += count;
+}
+
+std::vector<double> thread_busy_seconds() {
+   std::lock_guard<std::mutex> lock(registry_mutex);
+   std::vector<double> busy;
+   for (const auto &thread : registry)
+      busy.push_back(static_cast<double>(thread->busy_ns.load(
+                         std::memory_order_relaxed)) *
+                     1e-9);
+   return busy;
+}
+
+void write_trace(const std::string &path) {
+   std::ofstream file(path);
+   if (!file)
+      throw std::runtime_error("Cannot write " + path);
+   std::lock_guard<std::mutex> lock(registry_mutex);
+   int64_t origin = origin_ns.load();
+   file << std::fixed << std::setprecision(3);
+   file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+   const char *separator = "\n";
+   for (const auto &thread : registry) {
+      file << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", "
+           << "\"pid\": 1, \"tid\": " << thread->id
+           << ", \"args\": {\"name\": \"thread " << thread->id << "\"}}";
+      separator = ",\n";
+      for (const Trace_event &event : thread->events) {
+         file << separator << "{\"name\": \"" << event.name
+              << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread->id
+              << ", \"ts\": "
+              << static_cast<double>(event.start_ns - origin) * 1e-3
+              << ", \"dur\": "
+              << static_cast<double>(event.duration_ns) * 1e-3;
+         if (event.x >= 0)
+            file << ", \"args\": {\"x\": " << event.x
+                 << ", \"y\": " << event.y
+                 << ", \"iterations\": " << event.iterations << "}";
+         file << "}";
+      }
+   }
+   file << "\n]}\n";
+   if (!file)
+      throw std::runtime_error("Cannot write " + path);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Lightweight instrumentation. Timed scopes are appended to a buffer owned
+// by the thread that opens them, so recording takes no locks; each buffer
+// is registered once, on its thread's first scope. Nothing is recorded
+// until enable_tracing() is called, and a disabled scope costs one relaxed
+// load.
+
+struct Thread_trace;
+
+void enable_tracing();
+bool tracing_enabled();
+
+class Trace_scope {
+ public:
+   // A stage of the main loop, such as uploading a frame.
+   explicit Trace_scope(const char *name);
+
+   // A tile at (x, y). Time in tile scopes counts as the thread being busy.
+   Trace_scope(const char *name, size_t x, size_t y);
+
+   ~Trace_scope();
+
+   Trace_scope(const Trace_scope &) = delete;
+   Trace_scope &operator=(const Trace_scope &) = delete;
+
+ private:
+   void open(const char *name, int64_t x, int64_t y);
+
+   Thread_trace *thread_ = nullptr;
+   size_t event_ = 0;
+   int64_t start_ = 0;
+   bool tile_ = false;
+};
+
+// Adds to the iteration count of the innermost scope open on this thread.
+void trace_iterations(uint64_t count);
+
+// The time each thread has spent in tile scopes so far, in the order the
+// threads first recorded anything. Safe to call at any time.
+std::vector<double> thread_busy_seconds();
+
+// Writes every event recorded so far as a Chrome trace, which
+// chrome://tracing and Perfetto can show. No thread may be recording while
+// this runs.
+void write_trace(const std::string &path);
@@ -0,0 +1,113 @@
+#include "view_cache.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Moves plane[y * width + x] to plane[(y + dy) * width + x + dx], leaving
+// the exposed pixels as they were.
+template <typename T>
+void shift_plane(std::vector<T> &plane, size_t width, size_t height, long dx,
+                 long dy) {
+   size_t shift_x = static_cast<size_t>(std::labs(dx));
+   size_t shift_y = static_cast<size_t>(std::labs(dy));
+   size_t count = width - shift_x;
+   size_t from = dx < 0 ? shift_x : 0;
+   size_t to = dx > 0 ? shift_x : 0;
+   // Copy rows in the order that never overwrites a row still to be read.
+   for (size_t k = 0; k < height - shift_y; ++k) {
+      size_t y = dy > 0 ? height - 1 - k : k;
+      size_t source = dy > 0 ? y - shift_y : y + shift_y;
+      std::memmove(plane.data() + y * width + to,
+                   plane.data() + source * width + from, count * sizeof(T));
+   }
+}
+
+} // namespace
+
+void View_cache::pan(Thread_pool &pool, const Fractal &fractal,
+                     Render_settings settings, long dx, long dy) {
+   size_t width = escape_.width;
+   size_t height = escape_.height;
+   double pixel_re = 2.0 * viewport_.half_width / static_cast<double>(width);
+   double pixel_im = 2.0 * viewport_.half_height / static_cast<double>(height);
+   viewport_.centre_re =
+       viewport_.centre_re - static_cast<double>(dx) * pixel_re;
+   viewport_.centre_im =
+       viewport_.centre_im - static_cast<double>(dy) * pixel_im;
+   settings.viewport = viewport_;
+
+   size_t shift_x = static_cast<size_t>(std::labs(dx));
+   size_t shift_y = static_cast<size_t>(std::labs(dy));
+   if (shift_x >= width || shift_y >= height) {
+      render_escape(pool, fractal, settings, escape_);
+      return;
+   }
+   shift_plane(escape_.iterations, width, height, dx, dy);
+   shift_plane(escape_.norms, width, height, dx, dy);
+
+   // The exposed rows span the whole width; the exposed columns only the
+   // rows that were kept.
+   size_t kept_y = dy > 0 ? shift_y : 0;
+   if (shift_y > 0)
+      render_escape_region(pool, fractal, settings, escape_,
+                           {0, dy > 0 ? 0 : height - shift_y, width, shift_y});
+   if (shift_x > 0)
+      render_escape_region(pool, fractal, settings, escape_,
+                           {dx > 0 ? 0 : width - shift_x, kept_y, shift_x,
+                            height - shift_y});
+}
+
+void View_cache::zoom(double factor, double u, double v) {
+   Viewport old = viewport_;
+   double move_re = (u * 2.0 - 1.0) * old.half_width * (1.0 - factor);
+   double move_im = (v * 2.0 - 1.0) * old.half_height * (1.0 - factor);
+   viewport_.centre_re = old.centre_re + move_re;
+   viewport_.centre_im = old.centre_im + move_im;
+   viewport_.half_width = old.half_width * factor;
+   viewport_.half_height = old.half_height * factor;
+
+   size_t width = escape_.width;
+   size_t height = escape_.height;
+   // The old pixel under each new column and row, or -1 if none is.
+   auto old_pixels = [](size_t size, double move, double old_half,
+                        double new_half) {
+      std::vector<long> pixels(size);
+      for (size_t k = 0; k < size; ++k) {
+         double offset = move + (static_cast<double>(k) /
+                                     static_cast<double>(size) * 2.0 -
+                                 1.0) *
+                                    new_half;
+         double p = std::floor((offset / old_half + 1.0) * 0.5 *
+                               static_cast<double>(size));
+         pixels[k] = p >= 0 && p < static_cast<double>(size)
+                         ? static_cast<long>(p)
+                         : -1;
+      }
+      return pixels;
+   };
+   std::vector<long> columns =
+       old_pixels(width, move_re, old.half_width, viewport_.half_width);
+   std::vector<long> rows =
+       old_pixels(height, move_im, old.half_height, viewport_.half_height);
+
+   Escape_buffer resampled(width, height, escape_.max_iter);
+   for (size_t y = 0; y < height; ++y) {
+      for (size_t x = 0; x < width; ++x) {
+         size_t k = y * width + x;
+         if (rows[y] < 0 || columns[x] < 0) {
+            resampled.iterations[k] = 0;
+            resampled.norms[k] = compact_norm(5.0);
+            continue;
+         }
+         size_t source = static_cast<size_t>(rows[y]) * width +
+                         static_cast<size_t>(columns[x]);
+         resampled.iterations[k] = escape_.iterations[source];
+         resampled.norms[k] = escape_.norms[source];
+      }
+   }
+   escape_ = std::move(resampled);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "escape_buffer.h"
+#include "escape_time.h"
+#include "frame.h"
+#include "thread_pool.h"
+#include "viewport.h"
+
+#include <utility>
+
+// The escape times of the view last shown, kept so that the next view can
+// be built from them instead of being iterated from scratch.
+class View_cache {
+ public:
+   View_cache(Escape_buffer escape, const Viewport &viewport)
+       : escape_(std::move(escape)), viewport_(viewport) {}
+
+   Escape_buffer &escape() { return escape_; }
+   const Escape_buffer &escape() const { return escape_; }
+   const Viewport &viewport() const { return viewport_; }
+
+   // Moves the view by whole pixels, so that what was at pixel (x, y) is
+   // now at (x + dx, y + dy). The escape times still in view are shifted
+   // and only the newly exposed strips are iterated, with settings for
+   // everything but the viewport.
+   void pan(Thread_pool &pool, const Fractal &fractal,
+            Render_settings settings, long dx, long dy);
+
+   // Scales the view about normalised image coordinates (u, v), which stay
+   // over the same point, by factor; below one zooms in. The buffer is
+   // filled with the old escape times resampled to the new view, and
+   // points outside the old view are shown as escaping at once. These are
+   // placeholders: every pixel must then be iterated again.
+   void zoom(double factor, double u, double v);
+
+ private:
+   Escape_buffer escape_;
+   Viewport viewport_;
+};
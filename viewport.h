@@ -0,0 +1,88 @@
+#pragma once
+
+#include "double_double.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+// The region of the complex plane shown by an image. The centre is held in
+// double-double precision so that deep zooms can still locate it; the
+// extents are offsets from it, which a double represents at any depth.
+struct Viewport {
+   Double_double centre_re;
+   Double_double centre_im;
+   // Distance from the centre to the left and right edges, and to the top
+   // and bottom edges.
+   double half_width;
+   double half_height;
+};
+
+inline Viewport default_viewport() { return {0.0, 0.0, 2.0, 2.0}; }
+
+// Offsets from the centre of the columns and rows at normalised image
+// coordinates x and y.
+inline double offset_re(const Viewport &viewport, double x) {
+   return (x * 2.0 - 1.0) * viewport.half_width;
+}
+
+inline double offset_im(const Viewport &viewport, double y) {
+   return (y * 2.0 - 1.0) * viewport.half_height;
+}
+
+// The point at offset from centre, in the precision a kernel works in.
+template <typename Float_type>
+Float_type plane_coordinate(const Double_double &centre, double offset) {
+   return static_cast<Float_type>(static_cast<double>(centre) + offset);
+}
+
+template <>
+inline Double_double
+plane_coordinate<Double_double>(const Double_double &centre, double offset) {
+   return centre + offset;
+}
+
+enum class Precision { automatic, float32, float64, double_double };
+
+inline Precision parse_precision(const std::string &name) {
+   if (name == "auto")
+      return Precision::automatic;
+   if (name == "float")
+      return Precision::float32;
+   if (name == "double")
+      return Precision::float64;
+   if (name == "double-double")
+      return Precision::double_double;
+   throw std::runtime_error("Unknown precision: " + name);
+}
+
+// Picks the cheapest precision in which neighbouring pixels of a width x
+// height image of the viewport stay well apart. Rounding errors grow as a
+// point is iterated, so a pixel must span many units in the last place of
+// its coordinates, not just one.
+inline Precision choose_precision(const Viewport &viewport, size_t width,
+                                  size_t height) {
+   static constexpr double margin = 1024;
+   double spacing = 2.0 * std::min(viewport.half_width / width,
+                                   viewport.half_height / height);
+   double magnitude = std::max(
+       std::abs(static_cast<double>(viewport.centre_re)) + viewport.half_width,
+       std::abs(static_cast<double>(viewport.centre_im)) +
+           viewport.half_height);
+   if (spacing >= magnitude * FLT_EPSILON * margin)
+      return Precision::float32;
+   if (spacing >= magnitude * DBL_EPSILON * margin)
+      return Precision::float64;
+   return Precision::double_double;
+}
+
+inline Precision resolve_precision(Precision precision,
+                                   const Viewport &viewport, size_t width,
+                                   size_t height) {
+   if (precision == Precision::automatic)
+      return choose_precision(viewport, width, height);
+   return precision;
+}